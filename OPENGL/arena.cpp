@@ -0,0 +1,118 @@
+// arena.cpp
+//
+// Bump allocator with overflow blocks for requests bigger than reserved
+//////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "arena.h"
+
+#define ARENA_ALIGN 32
+
+struct ArenaBlock
+{
+  ArenaBlock *next;
+  size_t size;
+};
+
+static size_t alignUp(size_t n)
+{
+  return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+static void *allocOrDie(size_t bytes)
+{
+  void *p = aligned_alloc(ARENA_ALIGN, alignUp(bytes));
+  if (p == NULL)
+  {
+    fprintf(stderr, "ERROR: out of memory allocating %zu bytes of scratch\n", bytes);
+    abort();
+  }
+  return p;
+}
+
+void arenaReserve(ScratchArena *arena, size_t bytes)
+{
+  bytes = alignUp(bytes);
+  if (bytes <= arena->capacity)
+    return;
+
+  if (arena->used == 0)
+  {
+    free(arena->base);
+    arena->base = (char *)allocOrDie(bytes);
+    arena->capacity = bytes;
+  }
+  else if (arena->high_water < bytes)
+  {
+    // In use: grow at the next reset
+    arena->high_water = bytes;
+  }
+}
+
+void *arenaAlloc(ScratchArena *arena, size_t bytes)
+{
+  bytes = alignUp(bytes);
+
+  if (arena->used + bytes <= arena->capacity)
+  {
+    void *p = arena->base + arena->used;
+    arena->used += bytes;
+    if (arena->used + arena->overflow_used > arena->high_water)
+      arena->high_water = arena->used + arena->overflow_used;
+    return p;
+  }
+
+  // Does not fit: a block of its own, header in front keeps the alignment
+  ArenaBlock *block = (ArenaBlock *)allocOrDie(ARENA_ALIGN + bytes);
+  block->next = arena->overflow;
+  block->size = bytes;
+  arena->overflow = block;
+  arena->overflow_used += bytes;
+  if (arena->used + arena->overflow_used > arena->high_water)
+    arena->high_water = arena->used + arena->overflow_used;
+  return (char *)block + ARENA_ALIGN;
+}
+
+// Frees the overflow blocks newer than stop
+static void freeOverflow(ScratchArena *arena, ArenaBlock *stop)
+{
+  while (arena->overflow != stop)
+  {
+    ArenaBlock *next = arena->overflow->next;
+    arena->overflow_used -= arena->overflow->size;
+    free(arena->overflow);
+    arena->overflow = next;
+  }
+}
+
+ArenaMark arenaMark(const ScratchArena *arena)
+{
+  ArenaMark mark = {arena->used, arena->overflow};
+  return mark;
+}
+
+void arenaRewind(ScratchArena *arena, ArenaMark mark)
+{
+  freeOverflow(arena, mark.overflow);
+  arena->used = mark.used;
+}
+
+void arenaReset(ScratchArena *arena)
+{
+  freeOverflow(arena, NULL);
+
+  arena->used = 0;
+  if (arena->high_water > arena->capacity)
+    arenaReserve(arena, arena->high_water);
+  arena->high_water = 0;
+}
+
+void arenaRelease(ScratchArena *arena)
+{
+  arenaReset(arena);
+  free(arena->base);
+  arena->base = NULL;
+  arena->capacity = 0;
+}
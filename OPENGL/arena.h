@@ -0,0 +1,57 @@
+// arena.h: reusable scratch memory for mesh building temporaries
+//
+// Allocation is a pointer bump; everything is released at once with
+// arenaReset(). The memory is kept between resets, so building mesh after
+// mesh does no malloc/free once the arena has grown to the largest one.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+struct ArenaBlock;
+
+struct ScratchArena
+{
+  char *base;
+  size_t capacity;
+  size_t used;
+  size_t high_water;     // peak bytes since the last reset, overflow included
+  ArenaBlock *overflow;  // allocations that did not fit, freed on reset
+  size_t overflow_used;  // bytes in overflow blocks
+};
+
+#define SCRATCH_ARENA_INIT {NULL, 0, 0, 0, NULL, 0}
+
+// Position to go back to with arenaRewind()
+struct ArenaMark
+{
+  size_t used;
+  ArenaBlock *overflow;
+};
+
+// Makes sure the next bytes (after a reset) fit without overflow blocks
+void arenaReserve(ScratchArena *arena, size_t bytes);
+
+// 32-byte aligned, never NULL (aborts if out of memory). Contents undefined.
+void *arenaAlloc(ScratchArena *arena, size_t bytes);
+
+// Frees overflow blocks and grows the main block to the peak usage so the
+// same workload fits next time
+void arenaReset(ScratchArena *arena);
+
+// Frees what was allocated after mark (for loops that need the same
+// temporaries every iteration). The peak is kept for the next reset.
+ArenaMark arenaMark(const ScratchArena *arena);
+void arenaRewind(ScratchArena *arena, ArenaMark mark);
+
+void arenaRelease(ScratchArena *arena);
+
+template <typename T>
+T *arenaAllocArray(ScratchArena *arena, size_t count)
+{
+  return (T *)arenaAlloc(arena, sizeof(T) * count);
+}
+
+#endif
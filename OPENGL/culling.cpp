@@ -0,0 +1,290 @@
+// culling.cpp
+//
+// A box is outside the frustum when its corner furthest along a plane's
+// normal (the p-vertex) is behind that plane. Which corner that is depends
+// only on the signs of the normal, the same for every child of a node, so
+// the kernels pick the min or max array per axis and then evaluate the
+// plane for all children lane-wise.
+//////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "culling.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CULLING_X86 1
+#include <immintrin.h>
+#endif
+
+// Unused child slots: inside-out, so every plane rejects them
+#define EMPTY_MIN 1e30f
+#define EMPTY_MAX -1e30f
+
+Aabb transformAabb(const Aabb &box, const glm::mat4 &matrix)
+{
+  glm::vec3 center = 0.5f * (box.min + box.max);
+  glm::vec3 extent = 0.5f * (box.max - box.min);
+  glm::vec3 new_center = glm::vec3(matrix * glm::vec4(center, 1.0f));
+  glm::vec3 new_extent(0.0f);
+  for (int c = 0; c < 3; c++)
+    new_extent += glm::abs(glm::vec3(matrix[c])) * extent[c];
+  Aabb result = {new_center - new_extent, new_center + new_extent};
+  return result;
+}
+
+Frustum frustumFromMatrix(const glm::mat4 &m)
+{
+  // Rows of the matrix (glm is column-major)
+  glm::vec4 row[4];
+  for (int r = 0; r < 4; r++)
+    row[r] = glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]);
+
+  Frustum frustum;
+  for (int axis = 0; axis < 3; axis++)
+  {
+    frustum.planes[2 * axis] = row[3] + row[axis];
+    frustum.planes[2 * axis + 1] = row[3] - row[axis];
+  }
+  for (glm::vec4 &plane : frustum.planes)
+    plane = plane * (1.0f / glm::length(glm::vec3(plane)));
+  return frustum;
+}
+
+static BvhNode emptyNode()
+{
+  BvhNode node;
+  for (int k = 0; k < BVH_WIDTH; k++)
+  {
+    node.min_x[k] = node.min_y[k] = node.min_z[k] = EMPTY_MIN;
+    node.max_x[k] = node.max_y[k] = node.max_z[k] = EMPTY_MAX;
+    node.child[k] = 0;
+  }
+  return node;
+}
+
+// Splits order[first, first + count) in 2^depth ranges, halving at the
+// median center along the longest axis each time
+static void splitRange(int order[], const glm::vec3 centers[], int first, int count, int depth,
+                       std::vector<int> *starts)
+{
+  if (depth == 0 || count <= 1)
+  {
+    starts->push_back(first);
+    return;
+  }
+
+  glm::vec3 lo = centers[order[first]], hi = lo;
+  for (int i = first + 1; i < first + count; i++)
+  {
+    lo = glm::min(lo, centers[order[i]]);
+    hi = glm::max(hi, centers[order[i]]);
+  }
+  glm::vec3 size = hi - lo;
+  int axis = size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2);
+
+  int half = count / 2;
+  std::nth_element(order + first, order + first + half, order + first + count,
+                   [&](int a, int b) { return centers[a][axis] < centers[b][axis]; });
+  splitRange(order, centers, first, half, depth - 1, starts);
+  splitRange(order, centers, first + half, count - half, depth - 1, starts);
+}
+
+// Pre-order, so children always come after their parent
+static int buildNode(Bvh *bvh, int order[], const glm::vec3 centers[], int first, int count)
+{
+  int node = bvh->nodes.size();
+  bvh->nodes.push_back(emptyNode());
+
+  if (count <= BVH_WIDTH)
+  {
+    for (int k = 0; k < count; k++)
+      bvh->nodes[node].child[k] = ~order[first + k];
+    return node;
+  }
+
+  // 3 halvings: 8 ranges, none empty as count > 8
+  std::vector<int> starts;
+  splitRange(order, centers, first, count, 3, &starts);
+  starts.push_back(first + count);
+  for (int k = 0; k < BVH_WIDTH; k++)
+  {
+    int range = starts[k + 1] - starts[k];
+    int child = range == 1 ? ~order[starts[k]] : buildNode(bvh, order, centers, starts[k], range);
+    bvh->nodes[node].child[k] = child;
+  }
+  return node;
+}
+
+void bvhBuild(Bvh *bvh, const Aabb bounds[], int count)
+{
+  bvh->nodes.clear();
+  bvh->objects = count;
+  if (count == 0)
+    return;
+
+  std::vector<int> order(count);
+  std::vector<glm::vec3> centers(count);
+  for (int i = 0; i < count; i++)
+  {
+    order[i] = i;
+    centers[i] = 0.5f * (bounds[i].min + bounds[i].max);
+  }
+  buildNode(bvh, order.data(), centers.data(), 0, count);
+  bvhRefit(bvh, bounds);
+}
+
+static Aabb nodeBounds(const BvhNode &node)
+{
+  Aabb box = {glm::vec3(EMPTY_MIN), glm::vec3(EMPTY_MAX)};
+  for (int k = 0; k < BVH_WIDTH; k++)
+  {
+    box.min = glm::min(box.min, glm::vec3(node.min_x[k], node.min_y[k], node.min_z[k]));
+    box.max = glm::max(box.max, glm::vec3(node.max_x[k], node.max_y[k], node.max_z[k]));
+  }
+  return box;
+}
+
+void bvhRefit(Bvh *bvh, const Aabb bounds[])
+{
+  for (int n = (int)bvh->nodes.size() - 1; n >= 0; n--)
+  {
+    BvhNode &node = bvh->nodes[n];
+    for (int k = 0; k < BVH_WIDTH; k++)
+    {
+      int child = node.child[k];
+      if (child == 0)
+        continue;
+      Aabb box = child < 0 ? bounds[~child] : nodeBounds(bvh->nodes[child]);
+      node.min_x[k] = box.min.x;
+      node.min_y[k] = box.min.y;
+      node.min_z[k] = box.min.z;
+      node.max_x[k] = box.max.x;
+      node.max_y[k] = box.max.y;
+      node.max_z[k] = box.max.z;
+    }
+  }
+}
+
+// Bit k set when child k is not outside any plane
+typedef unsigned (*ChildMaskFn)(const BvhNode &node, const Frustum &frustum);
+
+static unsigned childMaskScalar(const BvhNode &node, const Frustum &frustum)
+{
+  unsigned mask = 0;
+  for (int k = 0; k < BVH_WIDTH; k++)
+  {
+    bool outside = false;
+    for (int p = 0; p < 6 && !outside; p++)
+    {
+      const glm::vec4 &plane = frustum.planes[p];
+      float x = plane.x > 0.0f ? node.max_x[k] : node.min_x[k];
+      float y = plane.y > 0.0f ? node.max_y[k] : node.min_y[k];
+      float z = plane.z > 0.0f ? node.max_z[k] : node.min_z[k];
+      outside = plane.x * x + plane.y * y + plane.z * z + plane.w < 0.0f;
+    }
+    if (!outside)
+      mask |= 1u << k;
+  }
+  return mask;
+}
+
+#ifdef CULLING_X86
+
+static unsigned childMaskSse(const BvhNode &node, const Frustum &frustum)
+{
+  unsigned mask = 0;
+  for (int h = 0; h < BVH_WIDTH; h += 4)
+  {
+    __m128 outside = _mm_setzero_ps();
+    for (int p = 0; p < 6; p++)
+    {
+      const glm::vec4 &plane = frustum.planes[p];
+      __m128 x = _mm_loadu_ps((plane.x > 0.0f ? node.max_x : node.min_x) + h);
+      __m128 y = _mm_loadu_ps((plane.y > 0.0f ? node.max_y : node.min_y) + h);
+      __m128 z = _mm_loadu_ps((plane.z > 0.0f ? node.max_z : node.min_z) + h);
+      __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), x), _mm_mul_ps(_mm_set1_ps(plane.y), y)),
+                            _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.z), z), _mm_set1_ps(plane.w)));
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(d, _mm_setzero_ps()));
+    }
+    mask |= (~_mm_movemask_ps(outside) & 0xf) << h;
+  }
+  return mask;
+}
+
+__attribute__((target("avx"))) static unsigned childMaskAvx(const BvhNode &node, const Frustum &frustum)
+{
+  __m256 outside = _mm256_setzero_ps();
+  for (int p = 0; p < 6; p++)
+  {
+    const glm::vec4 &plane = frustum.planes[p];
+    __m256 x = _mm256_loadu_ps(plane.x > 0.0f ? node.max_x : node.min_x);
+    __m256 y = _mm256_loadu_ps(plane.y > 0.0f ? node.max_y : node.min_y);
+    __m256 z = _mm256_loadu_ps(plane.z > 0.0f ? node.max_z : node.min_z);
+    __m256 d = _mm256_add_ps(
+        _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), x), _mm256_mul_ps(_mm256_set1_ps(plane.y), y)),
+        _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.z), z), _mm256_set1_ps(plane.w)));
+    outside = _mm256_or_ps(outside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_LT_OQ));
+  }
+  return ~_mm256_movemask_ps(outside) & 0xff;
+}
+
+#endif
+
+struct CullingKernel
+{
+  ChildMaskFn fn;
+  const char *name;
+};
+
+static CullingKernel selectKernel()
+{
+  CullingKernel k = {childMaskScalar, "scalar"};
+#ifdef CULLING_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx"))
+    k = {childMaskAvx, "avx"};
+  else if (__builtin_cpu_supports("sse2"))
+    k = {childMaskSse, "sse"};
+#endif
+  return k;
+}
+
+// Chosen on first use (thread-safe static initialization)
+static const CullingKernel &activeKernel()
+{
+  static const CullingKernel kernel = selectKernel();
+  return kernel;
+}
+
+void bvhCull(const Bvh *bvh, const Frustum &frustum, std::vector<int> *visible)
+{
+  if (bvh->nodes.empty())
+    return;
+
+  ChildMaskFn child_mask = activeKernel().fn;
+  int stack[128]; // 7 per level at most, depth <= 11 for int counts
+  int top = 0;
+  stack[top++] = 0;
+  while (top > 0)
+  {
+    const BvhNode &node = bvh->nodes[stack[--top]];
+    unsigned mask = child_mask(node, frustum);
+    for (int k = 0; k < BVH_WIDTH; k++)
+    {
+      int child = node.child[k];
+      if (!(mask & (1u << k)) || child == 0)
+        continue;
+      if (child < 0)
+        visible->push_back(~child);
+      else
+        stack[top++] = child;
+    }
+  }
+}
+
+const char *cullingKernel()
+{
+  return activeKernel().name;
+}
@@ -0,0 +1,67 @@
+// culling.h: frustum culling of object bounds through a BVH
+//
+// Each object's world AABB is its mesh's bounds carried through the model
+// matrix. A bounding volume hierarchy 8 children wide is built over them
+// once and refit (bounds only, same tree) when objects move; the children
+// of a node are stored SoA, so one traversal step tests all 8 boxes
+// against a frustum plane at once: two SSE halves or one AVX register,
+// picked at runtime like the normals kernels. Subtrees outside the frustum
+// are skipped whole.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#define BVH_WIDTH 8
+
+struct Aabb
+{
+  glm::vec3 min;
+  glm::vec3 max;
+};
+
+// Bounds of box once transformed by matrix (still axis aligned)
+Aabb transformAabb(const Aabb &box, const glm::mat4 &matrix);
+
+// Planes (normal, distance) with the normals pointing inwards
+struct Frustum
+{
+  glm::vec4 planes[6];
+};
+
+// The clip volume of projection * view
+Frustum frustumFromMatrix(const glm::mat4 &view_projection);
+
+struct BvhNode
+{
+  // Child boxes, SoA. Unused slots are empty (min > max).
+  float min_x[BVH_WIDTH], min_y[BVH_WIDTH], min_z[BVH_WIDTH];
+  float max_x[BVH_WIDTH], max_y[BVH_WIDTH], max_z[BVH_WIDTH];
+  // >= 0: a node, always after this one; < 0: object ~child; unused: 0
+  int child[BVH_WIDTH];
+};
+
+struct Bvh
+{
+  std::vector<BvhNode> nodes; // nodes[0] is the root
+  int objects;                // bounds it was built over
+};
+
+// Builds the tree over count object bounds (median splits along the
+// longest axis of their centers)
+void bvhBuild(Bvh *bvh, const Aabb bounds[], int count);
+
+// New bounds for the same objects: recomputed bottom-up, tree unchanged
+void bvhRefit(Bvh *bvh, const Aabb bounds[]);
+
+// Appends the objects whose box is not outside frustum to visible
+void bvhCull(const Bvh *bvh, const Frustum &frustum, std::vector<int> *visible);
+
+// "scalar", "sse" or "avx"
+const char *cullingKernel();
+
+#endif
@@ -0,0 +1,137 @@
+// draw_list.cpp
+//////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "draw_list.h"
+
+void drawListCreate(DrawList *list)
+{
+  list->multi_draw_indirect = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+  list->indirect_capacity = 0;
+  list->indirect_buffer = 0;
+  list->draw_calls = 0;
+  if (list->multi_draw_indirect)
+    glGenBuffers(1, &list->indirect_buffer);
+}
+
+void drawListDestroy(DrawList *list)
+{
+  if (list->indirect_buffer)
+    glDeleteBuffers(1, &list->indirect_buffer);
+  list->indirect_buffer = 0;
+}
+
+void drawListClear(DrawList *list)
+{
+  list->items.clear();
+  list->packets.clear();
+}
+
+// The bits of a positive float order like the float: the top 28 below the
+// (clear) sign bit keep that order at a coarser step
+static uint64_t depthBits(float depth)
+{
+  uint32_t bits = 0;
+  depth = std::max(depth, 0.0f);
+  memcpy(&bits, &depth, sizeof(bits));
+  return bits >> (31 - DRAW_KEY_DEPTH_BITS);
+}
+
+void drawListAdd(DrawList *list, int program, int bucket, int mesh_id, const Mesh &mesh, int lod, float depth,
+                 const glm::mat4 &model, const glm::mat3 &normal_matrix, GLuint material)
+{
+  SortPacket packet;
+  packet.key = ((uint64_t)program << DRAW_KEY_PROGRAM_SHIFT) | ((uint64_t)bucket << DRAW_KEY_BUCKET_SHIFT) |
+               ((uint64_t)mesh_id << DRAW_KEY_MESH_SHIFT) | ((uint64_t)lod << DRAW_KEY_LOD_SHIFT) | depthBits(depth);
+  packet.index = list->items.size();
+  list->packets.push_back(packet);
+
+  DrawItem item;
+  item.mesh = &mesh;
+  item.lod = lod;
+  item.instance.model = model;
+  for (int c = 0; c < 3; c++)
+    item.instance.normal[c] = glm::vec4(normal_matrix[c], 0.0f);
+  item.instance.material = material;
+  item.instance.padding[0] = item.instance.padding[1] = item.instance.padding[2] = 0;
+  list->items.push_back(item);
+}
+
+void drawListBuild(DrawList *list, InstanceBuffer *ib)
+{
+  int count = list->packets.size();
+  list->scratch.resize(count);
+  radixSort(list->packets.data(), list->scratch.data(), count);
+
+  list->instances.clear();
+  list->commands.clear();
+  list->command_items.clear();
+  list->batches.clear();
+
+  for (int p = 0; p < count; p++)
+  {
+    uint64_t key = list->packets[p].key;
+    const DrawItem &item = list->items[list->packets[p].index];
+    uint64_t previous = p > 0 ? list->packets[p - 1].key : 0;
+
+    // Same program and bucket: same batch. Same mesh and level too: same
+    // command.
+    if (p == 0 || key >> DRAW_KEY_BUCKET_SHIFT != previous >> DRAW_KEY_BUCKET_SHIFT)
+    {
+      int bucket = (key >> DRAW_KEY_BUCKET_SHIFT) & ((1u << (DRAW_KEY_PROGRAM_SHIFT - DRAW_KEY_BUCKET_SHIFT)) - 1);
+      DrawBatch batch = {(int)(key >> DRAW_KEY_PROGRAM_SHIFT), bucket, item.mesh, (int)list->commands.size(),
+                         (int)list->commands.size()};
+      list->batches.push_back(batch);
+    }
+    if (p == 0 || key >> DRAW_KEY_DEPTH_BITS != previous >> DRAW_KEY_DEPTH_BITS)
+    {
+      const MeshLod &level = item.mesh->lods[item.lod];
+      DrawElementsIndirectCommand command = {(GLuint)level.index_count, 0, item.mesh->first_index + level.first_index,
+                                             item.mesh->base_vertex, (GLuint)list->instances.size()};
+      list->commands.push_back(command);
+      list->command_items.push_back(list->packets[p].index);
+      list->batches.back().end_command++;
+    }
+    list->commands.back().instance_count++;
+    list->instances.push_back(item.instance);
+  }
+
+  instanceBufferUpload(ib, list->instances.data(), list->instances.size());
+
+  if (list->multi_draw_indirect)
+  {
+    int commands = list->commands.size();
+    if (list->indirect_capacity < commands)
+      list->indirect_capacity = std::max(commands, 2 * list->indirect_capacity);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, list->indirect_buffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) * list->indirect_capacity, NULL,
+                 GL_STREAM_DRAW);
+    glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(DrawElementsIndirectCommand) * commands,
+                    list->commands.data());
+  }
+  list->draw_calls = 0;
+}
+
+void drawListSubmit(DrawList *list, InstanceBuffer *ib, int batch)
+{
+  int first = list->batches[batch].first_command, end = list->batches[batch].end_command;
+
+  if (list->multi_draw_indirect)
+  {
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, list->indirect_buffer);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void *)(sizeof(DrawElementsIndirectCommand) * first),
+                                end - first, 0);
+    list->draw_calls++;
+    return;
+  }
+
+  for (int c = first; c < end; c++)
+  {
+    const DrawItem &item = list->items[list->command_items[c]];
+    drawInstances(ib, *item.mesh, item.lod, list->commands[c].base_instance, list->commands[c].instance_count);
+    list->draw_calls++;
+  }
+}
@@ -0,0 +1,97 @@
+// draw_list.h: every object of a frame as sorted indirect multi-draws
+//
+// Objects are added in any order as draw packets with a 64-bit sort key:
+// program, state bucket (what render() sets before a submit: textures,
+// per-mesh uniforms), mesh, level of detail and distance to the camera,
+// most significant first. Building radix sorts the packets, so GL state
+// changes once per distinct program and bucket. Packets that differ only
+// in distance become one DrawElementsIndirectCommand whose instances are
+// contiguous in the instance buffer (found through its base instance) and
+// ordered front to back, so early depth testing rejects the fragments
+// behind. Each run of commands with the same program and bucket is a
+// batch: a single glMultiDrawElementsIndirect() (GL 4.3), or a loop over
+// its commands on older contexts.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef DRAW_LIST_H
+#define DRAW_LIST_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "instance_buffer.h"
+#include "mesh.h"
+#include "radix_sort.h"
+
+// Sort key fields, from the most significant bit down:
+// program 4 | bucket 12 | mesh 16 | level 4 | depth 28
+#define DRAW_KEY_DEPTH_BITS 28
+#define DRAW_KEY_LOD_SHIFT 28
+#define DRAW_KEY_MESH_SHIFT 32
+#define DRAW_KEY_BUCKET_SHIFT 48
+#define DRAW_KEY_PROGRAM_SHIFT 60
+
+// Layout fixed by GL for GL_DRAW_INDIRECT_BUFFER
+struct DrawElementsIndirectCommand
+{
+  GLuint count;
+  GLuint instance_count;
+  GLuint first_index;
+  GLint base_vertex;
+  GLuint base_instance;
+};
+
+struct DrawItem
+{
+  const Mesh *mesh;
+  int lod;
+  InstanceData instance;
+};
+
+// Commands [first_command, end_command) share program and bucket
+struct DrawBatch
+{
+  int program;
+  int bucket;
+  const Mesh *mesh; // of the first command, for per-mesh state
+  int first_command, end_command;
+};
+
+struct DrawList
+{
+  std::vector<DrawItem> items;
+  std::vector<SortPacket> packets, scratch; // key and item of each packet
+  std::vector<InstanceData> instances;
+  std::vector<DrawElementsIndirectCommand> commands;
+  std::vector<int> command_items; // first item of each command
+  std::vector<DrawBatch> batches; // in key order
+
+  GLuint indirect_buffer;
+  int indirect_capacity;
+  bool multi_draw_indirect; // GL 4.3 / ARB_multi_draw_indirect
+
+  int draw_calls; // GL draw calls since the last build
+};
+
+// Needs the GL context
+void drawListCreate(DrawList *list);
+void drawListDestroy(DrawList *list);
+
+void drawListClear(DrawList *list);
+// program < 16, bucket < 4096 and mesh_id < 65536 identify the state and
+// the mesh; depth is the distance to the camera
+void drawListAdd(DrawList *list, int program, int bucket, int mesh_id, const Mesh &mesh, int lod, float depth,
+                 const glm::mat4 &model, const glm::mat3 &normal_matrix, GLuint material);
+
+// Sorts the packets into batches and commands, uploads instances and
+// commands
+void drawListBuild(DrawList *list, InstanceBuffer *ib);
+
+// Draws every command of batches[batch]. The VAO must be bound.
+void drawListSubmit(DrawList *list, InstanceBuffer *ib, int batch);
+
+#endif
@@ -0,0 +1,268 @@
+// geometry_heap.cpp
+//
+// Growing a buffer means a new, bigger one, a GPU side copy of the old
+// contents (glCopyBufferSubData) and pointing the VAO at it again. Offsets
+// handed out before stay valid.
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+
+#include <algorithm>
+
+#include "geometry_heap.h"
+#include "gl_state.h"
+
+bool rangeAlloc(RangeAllocator *allocator, GLuint size, GLuint *offset)
+{
+  if (size == 0)
+  {
+    *offset = 0;
+    return true;
+  }
+
+  std::vector<HeapRange> &ranges = allocator->free_ranges;
+  for (size_t i = 0; i < ranges.size(); i++)
+  {
+    if (ranges[i].size < size)
+      continue;
+    *offset = ranges[i].offset;
+    ranges[i].offset += size;
+    ranges[i].size -= size;
+    if (ranges[i].size == 0)
+      ranges.erase(ranges.begin() + i);
+    return true;
+  }
+  return false;
+}
+
+void rangeFree(RangeAllocator *allocator, GLuint offset, GLuint size)
+{
+  if (size == 0)
+    return;
+
+  std::vector<HeapRange> &ranges = allocator->free_ranges;
+  size_t i = std::lower_bound(ranges.begin(), ranges.end(), offset,
+                              [](const HeapRange &r, GLuint o) { return r.offset < o; }) -
+             ranges.begin();
+  HeapRange range = {offset, size};
+  ranges.insert(ranges.begin() + i, range);
+
+  // Merge with the following range, then with the previous one
+  if (i + 1 < ranges.size() && ranges[i].offset + ranges[i].size == ranges[i + 1].offset)
+  {
+    ranges[i].size += ranges[i + 1].size;
+    ranges.erase(ranges.begin() + i + 1);
+  }
+  if (i > 0 && ranges[i - 1].offset + ranges[i - 1].size == ranges[i].offset)
+  {
+    ranges[i - 1].size += ranges[i].size;
+    ranges.erase(ranges.begin() + i);
+  }
+}
+
+// Bytes per vertex of each vertex buffer of a layout, returns how many
+// buffers it uses
+static int vertexStreams(VertexLayout layout, GLsizeiptr sizes[3])
+{
+  if (layout == VERTEX_LAYOUT_SEPARATE)
+  {
+    sizes[0] = sizeof(glm::vec3);
+    sizes[1] = sizeof(glm::vec3);
+    sizes[2] = sizeof(glm::vec2);
+    return 3;
+  }
+  sizes[0] = layout == VERTEX_LAYOUT_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+  return 1;
+}
+
+// A buffer of new_size bytes starting with the first old_size of buffer
+// (0 = none), which is deleted
+static GLuint growBuffer(GLuint buffer, GLsizeiptr old_size, GLsizeiptr new_size)
+{
+  GLuint grown = 0;
+  glGenBuffers(1, &grown);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, grown);
+  glBufferData(GL_COPY_WRITE_BUFFER, new_size, NULL, GL_STATIC_DRAW);
+  if (buffer)
+  {
+    glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+    glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, old_size);
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glDeleteBuffers(1, &buffer);
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+  return grown;
+}
+
+// Points the VAO at the current buffers, same locations for every layout
+static void setAttributes(GeometryHeap *heap)
+{
+  stateBindVertexArray(heap->vao);
+
+  if (heap->layout == VERTEX_LAYOUT_SEPARATE)
+  {
+    glBindBuffer(GL_ARRAY_BUFFER, heap->vbo[0]);
+    glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    glBindBuffer(GL_ARRAY_BUFFER, heap->vbo[1]);
+    glVertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+    glBindBuffer(GL_ARRAY_BUFFER, heap->vbo[2]);
+    glVertexAttribPointer(ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+  }
+  else if (heap->layout == VERTEX_LAYOUT_PACKED)
+  {
+    // Normalized integers reach the shader as floats in [0, 1] / [-1, 1]
+    glBindBuffer(GL_ARRAY_BUFFER, heap->vbo[0]);
+    glVertexAttribPointer(ATTRIB_POSITION, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex),
+                          (void *)offsetof(PackedVertex, position));
+    glVertexAttribPointer(ATTRIB_NORMAL, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex),
+                          (void *)offsetof(PackedVertex, normal));
+    glVertexAttribPointer(ATTRIB_TEXCOORD, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex),
+                          (void *)offsetof(PackedVertex, uv));
+  }
+  else
+  {
+    // Every attribute of a vertex together, a single fetch
+    glBindBuffer(GL_ARRAY_BUFFER, heap->vbo[0]);
+    glVertexAttribPointer(ATTRIB_POSITION, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, position));
+    glVertexAttribPointer(ATTRIB_NORMAL, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, normal));
+    glVertexAttribPointer(ATTRIB_TEXCOORD, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *)offsetof(Vertex, uv));
+  }
+  glEnableVertexAttribArray(ATTRIB_POSITION);
+  glEnableVertexAttribArray(ATTRIB_NORMAL);
+  glEnableVertexAttribArray(ATTRIB_TEXCOORD);
+
+  // The element buffer binding is part of the VAO state: unbind the VAO
+  // first so it keeps it
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, heap->ebo);
+  stateBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+static void growVertices(GeometryHeap *heap, GLuint capacity)
+{
+  GLsizeiptr sizes[3];
+  int streams = vertexStreams(heap->layout, sizes);
+  GLuint old_capacity = heap->vertices.capacity;
+  for (int s = 0; s < streams; s++)
+    heap->vbo[s] = growBuffer(heap->vbo[s], sizes[s] * old_capacity, sizes[s] * capacity);
+
+  heap->vertices.capacity = capacity;
+  rangeFree(&heap->vertices, old_capacity, capacity - old_capacity);
+}
+
+static void growIndices(GeometryHeap *heap, GLuint capacity)
+{
+  GLuint old_capacity = heap->indices.capacity;
+  heap->ebo = growBuffer(heap->ebo, sizeof(GLuint) * old_capacity, sizeof(GLuint) * capacity);
+
+  heap->indices.capacity = capacity;
+  rangeFree(&heap->indices, old_capacity, capacity - old_capacity);
+}
+
+GeometryHeap *geometryHeapCreate(VertexLayout layout)
+{
+  GeometryHeap *heap = new GeometryHeap();
+  heap->layout = layout;
+  glGenVertexArrays(1, &heap->vao);
+  growVertices(heap, GEOMETRY_HEAP_VERTICES);
+  growIndices(heap, GEOMETRY_HEAP_INDICES);
+  setAttributes(heap);
+  return heap;
+}
+
+void geometryHeapDestroy(GeometryHeap *heap)
+{
+  if (heap == NULL)
+    return;
+
+  glDeleteVertexArrays(1, &heap->vao);
+  stateInvalidate();
+  for (GLuint &vbo : heap->vbo)
+    if (vbo)
+      glDeleteBuffers(1, &vbo);
+  glDeleteBuffers(1, &heap->ebo);
+  delete heap;
+}
+
+static void writeVertices(GeometryHeap *heap, GLuint base, const Vertex vertices[], int count, Mesh *mesh)
+{
+  GLsizeiptr sizes[3];
+  vertexStreams(heap->layout, sizes);
+
+  if (heap->layout == VERTEX_LAYOUT_SEPARATE)
+  {
+    std::vector<glm::vec3> positions(count), normals(count);
+    std::vector<glm::vec2> uvs(count);
+    for (int i = 0; i < count; i++)
+    {
+      positions[i] = vertices[i].position;
+      normals[i] = vertices[i].normal;
+      uvs[i] = vertices[i].uv;
+    }
+    const void *streams[3] = {positions.data(), normals.data(), uvs.data()};
+    for (int s = 0; s < 3; s++)
+    {
+      glBindBuffer(GL_COPY_WRITE_BUFFER, heap->vbo[s]);
+      glBufferSubData(GL_COPY_WRITE_BUFFER, sizes[s] * base, sizes[s] * count, streams[s]);
+    }
+  }
+  else if (heap->layout == VERTEX_LAYOUT_PACKED)
+  {
+    std::vector<PackedVertex> packed(count);
+    packVertices(vertices, count, packed.data(), &mesh->position_offset, &mesh->position_scale);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, heap->vbo[0]);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, sizes[0] * base, sizes[0] * count, packed.data());
+  }
+  else
+  {
+    glBindBuffer(GL_COPY_WRITE_BUFFER, heap->vbo[0]);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, sizes[0] * base, sizes[0] * count, vertices);
+  }
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void geometryHeapUpload(GeometryHeap *heap, const Vertex vertices[], int vertex_count, const GLuint indices[],
+                        int index_count, Mesh *mesh)
+{
+  GLuint base = 0, first = 0;
+  bool grown = false;
+  while (!rangeAlloc(&heap->vertices, vertex_count, &base))
+  {
+    growVertices(heap, std::max(heap->vertices.capacity * 2, heap->vertices.capacity + vertex_count));
+    grown = true;
+  }
+  while (!rangeAlloc(&heap->indices, index_count, &first))
+  {
+    growIndices(heap, std::max(heap->indices.capacity * 2, heap->indices.capacity + index_count));
+    grown = true;
+  }
+  if (grown)
+    setAttributes(heap);
+
+  mesh->position_offset = glm::vec3(0.0f);
+  mesh->position_scale = glm::vec3(1.0f);
+  writeVertices(heap, base, vertices, vertex_count, mesh);
+
+  glBindBuffer(GL_COPY_WRITE_BUFFER, heap->ebo);
+  glBufferSubData(GL_COPY_WRITE_BUFFER, sizeof(GLuint) * first, sizeof(GLuint) * index_count, indices);
+  glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+  mesh->base_vertex = base;
+  mesh->first_index = first;
+  mesh->vertex_count = vertex_count;
+  mesh->index_count = index_count;
+  mesh->bounds_min = mesh->bounds_max = glm::vec3(0.0f);
+  mesh->lod_count = 1;
+  mesh->lods[0].first_index = 0;
+  mesh->lods[0].index_count = index_count;
+  mesh->lods[0].error = 0.0f;
+}
+
+void geometryHeapFree(GeometryHeap *heap, Mesh *mesh)
+{
+  rangeFree(&heap->vertices, mesh->base_vertex, mesh->vertex_count);
+  rangeFree(&heap->indices, mesh->first_index, mesh->index_count);
+  mesh->vertex_count = mesh->index_count = 0;
+  mesh->lod_count = 0;
+}
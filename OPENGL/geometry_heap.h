@@ -0,0 +1,63 @@
+// geometry_heap.h: every static mesh in one vertex and one element buffer
+//
+// Meshes get a range of vertices and a range of indices from free-list
+// suballocators and are all drawn through one VAO with
+// glDrawElementsBaseVertex(): their indices stay relative to the mesh and
+// base_vertex says where its vertices start. Binding the heap once per
+// frame replaces the VAO switch per object, and meshes sharing the
+// buffers can be batched into a single multi-draw.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef GEOMETRY_HEAP_H
+#define GEOMETRY_HEAP_H
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include "mesh.h"
+
+// Capacities the heap starts with, it doubles when full
+#define GEOMETRY_HEAP_VERTICES (1 << 16)
+#define GEOMETRY_HEAP_INDICES (1 << 18)
+
+struct HeapRange
+{
+  GLuint offset, size;
+};
+
+// First fit over the free ranges, kept sorted by offset and merged with
+// their neighbours when freed. In elements (vertices or indices).
+struct RangeAllocator
+{
+  GLuint capacity;
+  std::vector<HeapRange> free_ranges;
+};
+
+// false if no free range is big enough
+bool rangeAlloc(RangeAllocator *allocator, GLuint size, GLuint *offset);
+void rangeFree(RangeAllocator *allocator, GLuint offset, GLuint size);
+
+struct GeometryHeap
+{
+  VertexLayout layout;
+  GLuint vao;
+  GLuint vbo[3]; // one per attribute with VERTEX_LAYOUT_SEPARATE, else only vbo[0]
+  GLuint ebo;
+  RangeAllocator vertices, indices;
+};
+
+// Needs the GL context
+GeometryHeap *geometryHeapCreate(VertexLayout layout);
+void geometryHeapDestroy(GeometryHeap *heap);
+
+// Copies a mesh into the heap, growing the buffers if it does not fit.
+// Sets every field of mesh; it has a single level of detail covering all
+// the indices.
+void geometryHeapUpload(GeometryHeap *heap, const Vertex vertices[], int vertex_count, const GLuint indices[],
+                        int index_count, Mesh *mesh);
+
+// Returns the ranges of mesh to the heap
+void geometryHeapFree(GeometryHeap *heap, Mesh *mesh);
+
+#endif
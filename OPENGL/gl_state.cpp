@@ -0,0 +1,224 @@
+// gl_state.cpp
+//
+// Uniform values are stored as 32-bit words, up to a mat4 per location,
+// in a table per program that grows with the highest location used.
+// Values are compared bitwise: -0.0 and 0.0 count as different, which
+// only costs a redundant upload.
+//////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "gl_state.h"
+
+#define UNIFORM_WORDS 16
+
+struct ProgramShadow
+{
+  GLuint program;
+  std::vector<uint32_t> values; // UNIFORM_WORDS per location
+  std::vector<char> valid;      // per location
+};
+
+// 0 is a valid "nothing bound" value, so a separate flag says whether the
+// shadow knows the GL value at all
+struct StateShadow
+{
+  bool known;
+  GLuint program;
+  GLuint vao;
+  int active_unit;
+  GLuint textures[STATE_TEXTURE_UNITS];
+  bool viewport_known;
+  GLint viewport[4];
+  std::deque<ProgramShadow> programs; // stable addresses for current
+  ProgramShadow *current;             // uniforms of program
+};
+
+static StateShadow shadow;
+static StateStats stats;
+
+void stateCount(bool skipped)
+{
+  if (skipped)
+    stats.skipped++;
+  else
+    stats.issued++;
+}
+
+void stateInvalidate()
+{
+  shadow.known = false;
+  shadow.viewport_known = false;
+  for (ProgramShadow &p : shadow.programs)
+    std::fill(p.valid.begin(), p.valid.end(), 0);
+}
+
+// Before the first call nothing is known: -1 is never a GL name
+static void makeKnown()
+{
+  if (shadow.known)
+    return;
+  shadow.known = true;
+  shadow.program = shadow.vao = (GLuint)-1;
+  shadow.active_unit = -1;
+  for (GLuint &t : shadow.textures)
+    t = (GLuint)-1;
+}
+
+void stateUseProgram(GLuint program)
+{
+  makeKnown();
+
+  // The uniform table follows the program even when the call is skipped
+  if (shadow.current == NULL || shadow.current->program != program)
+  {
+    shadow.current = NULL;
+    for (ProgramShadow &p : shadow.programs)
+      if (p.program == program)
+        shadow.current = &p;
+    if (shadow.current == NULL)
+    {
+      ProgramShadow p;
+      p.program = program;
+      shadow.programs.push_back(p);
+      shadow.current = &shadow.programs.back();
+    }
+  }
+
+  if (shadow.program == program)
+  {
+    stateCount(true);
+    return;
+  }
+  shadow.program = program;
+  stateCount(false);
+  glUseProgram(program);
+}
+
+void stateBindVertexArray(GLuint vao)
+{
+  makeKnown();
+  if (shadow.vao == vao)
+  {
+    stateCount(true);
+    return;
+  }
+  shadow.vao = vao;
+  stateCount(false);
+  glBindVertexArray(vao);
+}
+
+void stateBindTexture2D(int unit, GLuint texture)
+{
+  makeKnown();
+  if (unit < 0 || unit >= STATE_TEXTURE_UNITS)
+  {
+    // Not shadowed: always sent, and the active unit is unknown after it
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    shadow.active_unit = -1;
+    stateCount(false);
+    return;
+  }
+
+  if (shadow.textures[unit] == texture)
+  {
+    stateCount(true);
+    return;
+  }
+  if (shadow.active_unit != unit)
+  {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    shadow.active_unit = unit;
+  }
+  shadow.textures[unit] = texture;
+  stateCount(false);
+  glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+void stateViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+  GLint viewport[4] = {x, y, width, height};
+  if (shadow.viewport_known && memcmp(viewport, shadow.viewport, sizeof(viewport)) == 0)
+  {
+    stateCount(true);
+    return;
+  }
+  memcpy(shadow.viewport, viewport, sizeof(viewport));
+  shadow.viewport_known = true;
+  stateCount(false);
+  glViewport(x, y, width, height);
+}
+
+// true (and the shadow updated) if the value differs from the last one
+// sent to location of the current program
+static bool uniformChanged(GLint location, const void *value, size_t size)
+{
+  ProgramShadow *p = shadow.current;
+  if (p == NULL)
+  {
+    stateCount(false);
+    return true;
+  }
+
+  if ((size_t)location >= p->valid.size())
+  {
+    p->valid.resize(location + 1, 0);
+    p->values.resize((location + 1) * UNIFORM_WORDS);
+  }
+  uint32_t *stored = &p->values[location * UNIFORM_WORDS];
+  if (p->valid[location] && memcmp(stored, value, size) == 0)
+  {
+    stateCount(true);
+    return false;
+  }
+  memcpy(stored, value, size);
+  p->valid[location] = 1;
+  stateCount(false);
+  return true;
+}
+
+void stateUniform1i(GLint location, GLint value)
+{
+  if (location >= 0 && uniformChanged(location, &value, sizeof(value)))
+    glUniform1i(location, value);
+}
+
+void stateUniform3f(GLint location, const glm::vec3 &value)
+{
+  if (location >= 0 && uniformChanged(location, glm::value_ptr(value), sizeof(value)))
+    glUniform3fv(location, 1, glm::value_ptr(value));
+}
+
+void stateUniformMatrix3(GLint location, const glm::mat3 &value)
+{
+  if (location >= 0 && uniformChanged(location, glm::value_ptr(value), sizeof(value)))
+    glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+void stateUniformMatrix4(GLint location, const glm::mat4 &value)
+{
+  if (location >= 0 && uniformChanged(location, glm::value_ptr(value), sizeof(value)))
+    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+StateStats stateStats()
+{
+  return stats;
+}
+
+void statePrintStats(int frames)
+{
+  uint64_t total = stats.issued + stats.skipped;
+  if (frames <= 0 || total == 0)
+    return;
+  printf("GL state calls per frame: %.1f issued, %.1f skipped (%.0f%% redundant)\n", (double)stats.issued / frames,
+         (double)stats.skipped / frames, 100.0 * stats.skipped / total);
+}
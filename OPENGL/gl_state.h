@@ -0,0 +1,48 @@
+// gl_state.h: shadow of the GL state render() touches
+//
+// Binds and uniform uploads go through these functions, which remember
+// the last value sent and skip the GL call when it would not change
+// anything. Uniforms are shadowed per program and location. Everything
+// that changes this state has to use the layer (or stateInvalidate()
+// after touching it directly), otherwise the shadow goes stale.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <stdint.h>
+
+#define STATE_TEXTURE_UNITS 8
+
+struct StateStats
+{
+  uint64_t issued;  // calls that reached GL
+  uint64_t skipped; // calls dropped as redundant
+};
+
+void stateUseProgram(GLuint program);
+void stateBindVertexArray(GLuint vao);
+// Active texture unit and 2D texture together
+void stateBindTexture2D(int unit, GLuint texture);
+void stateViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+// For the program in use; location -1 is ignored like GL does
+void stateUniform1i(GLint location, GLint value);
+void stateUniform3f(GLint location, const glm::vec3 &value);
+void stateUniformMatrix3(GLint location, const glm::mat3 &value);
+void stateUniformMatrix4(GLint location, const glm::mat4 &value);
+
+// For uploads that track their own changes (uniform_blocks.h)
+void stateCount(bool skipped);
+
+// Forgets every shadowed value: the next call of each kind reaches GL
+void stateInvalidate();
+
+StateStats stateStats();
+// Issued and skipped calls per frame over frames
+void statePrintStats(int frames);
+
+#endif
@@ -0,0 +1,237 @@
+// gpu_profiler.cpp
+//
+// GPU timer-query profiler for the sections of render()
+//////////////////////////////////////////////////////////////////////
+
+#include <GL/glew.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include "gpu_profiler.h"
+
+struct GpuFrameQueries
+{
+  GLuint begin[GPU_SECTION_COUNT];
+  GLuint end[GPU_SECTION_COUNT];
+  unsigned int issued; // bitmask of sections with both queries issued
+  bool pending;        // waiting for results
+  int frame;
+};
+
+struct GpuFrameSample
+{
+  int frame;
+  double ms[GPU_SECTION_COUNT]; // negative if the section was not issued
+};
+
+static const char *section_names[GPU_SECTION_COUNT] = {
+    "clear",
+    "uniforms",
+    "draws",
+    "occlusion"};
+
+static bool enabled = false;
+static GpuFrameQueries ring[GPU_PROFILER_FRAMES];
+static int current = 0;
+static int frame_count = 0;
+static unsigned int begun = 0;
+
+static std::vector<GpuFrameSample> history;
+static double window[GPU_SECTION_COUNT][GPU_PROFILER_WINDOW];
+static int window_samples[GPU_SECTION_COUNT];
+
+static bool resolve(GpuFrameQueries &q);
+
+bool gpuProfilerInit()
+{
+  for (int i = 0; i < GPU_PROFILER_FRAMES; i++)
+  {
+    glGenQueries(GPU_SECTION_COUNT, ring[i].begin);
+    glGenQueries(GPU_SECTION_COUNT, ring[i].end);
+    ring[i].issued = 0;
+    ring[i].pending = false;
+  }
+
+  GLint bits = 0;
+  glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+  if (bits == 0)
+  {
+    fprintf(stderr, "ERROR: GL_TIMESTAMP queries not supported, GPU profiler disabled\n");
+    gpuProfilerTerminate();
+    return false;
+  }
+
+  enabled = true;
+  return true;
+}
+
+void gpuProfilerTerminate()
+{
+  // Shutting down, so waiting is fine: keep the last frames in the results
+  if (enabled)
+  {
+    glFinish();
+    for (int i = 1; i <= GPU_PROFILER_FRAMES; i++)
+      resolve(ring[(current + i) % GPU_PROFILER_FRAMES]);
+  }
+
+  for (int i = 0; i < GPU_PROFILER_FRAMES; i++)
+  {
+    glDeleteQueries(GPU_SECTION_COUNT, ring[i].begin);
+    glDeleteQueries(GPU_SECTION_COUNT, ring[i].end);
+  }
+  enabled = false;
+}
+
+bool gpuProfilerEnabled()
+{
+  return enabled;
+}
+
+// Reads back a frame if the GPU is done with it. Never waits.
+static bool resolve(GpuFrameQueries &q)
+{
+  if (!q.pending)
+    return true;
+
+  // Queries complete in order, so the last one issued tells about all of them
+  for (int s = GPU_SECTION_COUNT - 1; s >= 0; s--)
+  {
+    if (q.issued & (1u << s))
+    {
+      GLint available = 0;
+      glGetQueryObjectiv(q.end[s], GL_QUERY_RESULT_AVAILABLE, &available);
+      if (!available)
+        return false;
+      break;
+    }
+  }
+
+  GpuFrameSample sample;
+  sample.frame = q.frame;
+  for (int s = 0; s < GPU_SECTION_COUNT; s++)
+  {
+    sample.ms[s] = -1.0;
+    if (!(q.issued & (1u << s)))
+      continue;
+
+    GLuint64 t0 = 0, t1 = 0;
+    glGetQueryObjectui64v(q.begin[s], GL_QUERY_RESULT, &t0);
+    glGetQueryObjectui64v(q.end[s], GL_QUERY_RESULT, &t1);
+    sample.ms[s] = (t1 - t0) * 1e-6;
+
+    window[s][window_samples[s] % GPU_PROFILER_WINDOW] = sample.ms[s];
+    window_samples[s]++;
+  }
+  history.push_back(sample);
+
+  q.pending = false;
+  return true;
+}
+
+void gpuProfilerBeginFrame()
+{
+  if (!enabled)
+    return;
+
+  // Collect whatever finished meanwhile, oldest frame first
+  for (int i = 1; i <= GPU_PROFILER_FRAMES; i++)
+    resolve(ring[(current + i) % GPU_PROFILER_FRAMES]);
+
+  // Still busy after GPU_PROFILER_FRAMES frames: drop the sample rather than stall
+  GpuFrameQueries &q = ring[current];
+  q.pending = false;
+  q.issued = 0;
+  q.frame = frame_count;
+  begun = 0;
+}
+
+void gpuProfilerEndFrame()
+{
+  if (!enabled)
+    return;
+
+  ring[current].pending = ring[current].issued != 0;
+  current = (current + 1) % GPU_PROFILER_FRAMES;
+  frame_count++;
+}
+
+void gpuProfilerBegin(GpuSection section)
+{
+  if (!enabled)
+    return;
+
+  glQueryCounter(ring[current].begin[section], GL_TIMESTAMP);
+  begun |= 1u << section;
+}
+
+void gpuProfilerEnd(GpuSection section)
+{
+  if (!enabled || !(begun & (1u << section)))
+    return;
+
+  glQueryCounter(ring[current].end[section], GL_TIMESTAMP);
+  ring[current].issued |= 1u << section;
+}
+
+const char *gpuProfilerSectionName(GpuSection section)
+{
+  return section_names[section];
+}
+
+double gpuProfilerAverage(GpuSection section)
+{
+  int n = window_samples[section] < GPU_PROFILER_WINDOW ? window_samples[section] : GPU_PROFILER_WINDOW;
+  if (n == 0)
+    return 0.0;
+
+  double sum = 0.0;
+  for (int i = 0; i < n; i++)
+    sum += window[section][i];
+  return sum / n;
+}
+
+int gpuProfilerResolvedFrames()
+{
+  return (int)history.size();
+}
+
+bool gpuProfilerDumpCsv(const char *path)
+{
+  FILE *fp = fopen(path, "w");
+  if (fp == NULL)
+  {
+    fprintf(stderr, "ERROR: could not open %s for writing\n", path);
+    return false;
+  }
+
+  fprintf(fp, "frame");
+  for (int s = 0; s < GPU_SECTION_COUNT; s++)
+    fprintf(fp, ",%s_ms", section_names[s]);
+  fprintf(fp, "\n");
+
+  for (size_t i = 0; i < history.size(); i++)
+  {
+    fprintf(fp, "%d", history[i].frame);
+    for (int s = 0; s < GPU_SECTION_COUNT; s++)
+    {
+      if (history[i].ms[s] < 0.0)
+        fprintf(fp, ",");
+      else
+        fprintf(fp, ",%.6f", history[i].ms[s]);
+    }
+    fprintf(fp, "\n");
+  }
+
+  fclose(fp);
+  return true;
+}
+
+void gpuProfilerPrintAverages()
+{
+  printf("GPU time per section (avg of last %d frames, %d resolved):\n",
+         GPU_PROFILER_WINDOW, gpuProfilerResolvedFrames());
+  for (int s = 0; s < GPU_SECTION_COUNT; s++)
+    printf("  %-10s %.4f ms\n", section_names[s], gpuProfilerAverage((GpuSection)s));
+}
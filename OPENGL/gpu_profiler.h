@@ -0,0 +1,45 @@
+// gpu_profiler.h: GPU timing of the render() sections with timer queries
+//
+// Each section is bracketed by two GL_TIMESTAMP queries. Queries live in a
+// ring of GPU_PROFILER_FRAMES frames and are only read back once the GPU
+// says they are available, so profiling never stalls the pipeline.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+enum GpuSection
+{
+  GPU_SECTION_CLEAR,
+  GPU_SECTION_UNIFORMS,
+  GPU_SECTION_DRAWS,     // every object, submitted as multi-draws
+  GPU_SECTION_OCCLUSION, // box queries for the next frames (--occlusion)
+  GPU_SECTION_COUNT
+};
+
+// Frames in flight before a query set is reused
+#define GPU_PROFILER_FRAMES 4
+// Samples in the rolling average of each section
+#define GPU_PROFILER_WINDOW 60
+
+// Creates the query objects. Until called every other function is a no-op.
+bool gpuProfilerInit();
+void gpuProfilerTerminate();
+bool gpuProfilerEnabled();
+
+void gpuProfilerBeginFrame();
+void gpuProfilerEndFrame();
+void gpuProfilerBegin(GpuSection section);
+void gpuProfilerEnd(GpuSection section);
+
+const char *gpuProfilerSectionName(GpuSection section);
+// Rolling average of the last GPU_PROFILER_WINDOW resolved frames, in ms
+double gpuProfilerAverage(GpuSection section);
+// Number of frames whose results were read back
+int gpuProfilerResolvedFrames();
+
+// One line per resolved frame with the time of every section in ms
+bool gpuProfilerDumpCsv(const char *path);
+void gpuProfilerPrintAverages();
+
+#endif
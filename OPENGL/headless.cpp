@@ -0,0 +1,160 @@
+// headless.cpp
+//
+// Offscreen rendering through an EGL surfaceless context. Every frame goes
+// into an FBO instead of a window, so the program can run on render nodes
+// without display or GPU (Mesa llvmpipe).
+//////////////////////////////////////////////////////////////////////
+
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "headless.h"
+
+static EGLDisplay egl_display = EGL_NO_DISPLAY;
+static EGLContext egl_context = EGL_NO_CONTEXT;
+static GLuint fbo = 0, color_rbo = 0, depth_rbo = 0;
+
+bool headlessInit()
+{
+  // Surfaceless platform if available, default display otherwise
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if (getPlatformDisplay)
+    egl_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+  if (egl_display == EGL_NO_DISPLAY)
+    egl_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+  EGLint major, minor;
+  if (egl_display == EGL_NO_DISPLAY || !eglInitialize(egl_display, &major, &minor))
+  {
+    fprintf(stderr, "ERROR: could not initialize EGL (0x%x)\n", eglGetError());
+    return false;
+  }
+
+  const char *extensions = eglQueryString(egl_display, EGL_EXTENSIONS);
+  if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context"))
+  {
+    fprintf(stderr, "ERROR: EGL_KHR_surfaceless_context not supported\n");
+    return false;
+  }
+
+  const EGLint config_attribs[] = {
+      EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+      EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+      EGL_NONE};
+  EGLConfig config;
+  EGLint num_configs = 0;
+  if (!eglChooseConfig(egl_display, config_attribs, &config, 1, &num_configs) || num_configs < 1)
+  {
+    fprintf(stderr, "ERROR: no EGL config with desktop OpenGL support\n");
+    return false;
+  }
+
+  // Same kind of context GLFW gives us by default (no explicit profile)
+  eglBindAPI(EGL_OPENGL_API);
+  egl_context = eglCreateContext(egl_display, config, EGL_NO_CONTEXT, NULL);
+  if (egl_context == EGL_NO_CONTEXT)
+  {
+    fprintf(stderr, "ERROR: could not create EGL context (0x%x)\n", eglGetError());
+    return false;
+  }
+
+  if (!eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, egl_context))
+  {
+    fprintf(stderr, "ERROR: could not make EGL context current (0x%x)\n", eglGetError());
+    return false;
+  }
+
+  printf("EGL version %d.%d (%s)\n", major, minor, eglQueryString(egl_display, EGL_VENDOR));
+
+  return true;
+}
+
+bool headlessCreateFramebuffer(int width, int height)
+{
+  glGenFramebuffers(1, &fbo);
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+  glGenRenderbuffers(1, &color_rbo);
+  glBindRenderbuffer(GL_RENDERBUFFER, color_rbo);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_rbo);
+
+  glGenRenderbuffers(1, &depth_rbo);
+  glBindRenderbuffer(GL_RENDERBUFFER, depth_rbo);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth_rbo);
+
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+  {
+    fprintf(stderr, "ERROR: offscreen framebuffer is incomplete\n");
+    return false;
+  }
+
+  // Without a window there is no back buffer to pick
+  glDrawBuffer(GL_COLOR_ATTACHMENT0);
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+  return true;
+}
+
+void headlessTerminate()
+{
+  if (egl_display == EGL_NO_DISPLAY)
+    return;
+
+  if (egl_context != EGL_NO_CONTEXT)
+  {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteRenderbuffers(1, &depth_rbo);
+    glDeleteRenderbuffers(1, &color_rbo);
+    glDeleteFramebuffers(1, &fbo);
+
+    eglMakeCurrent(egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(egl_display, egl_context);
+    egl_context = EGL_NO_CONTEXT;
+  }
+
+  eglTerminate(egl_display);
+  egl_display = EGL_NO_DISPLAY;
+}
+
+// Nearest-rank percentile over an already sorted array
+static double percentile(const std::vector<double> &sorted, double p)
+{
+  size_t rank = (size_t)(p / 100.0 * sorted.size() + 0.5);
+  if (rank < 1)
+    rank = 1;
+  if (rank > sorted.size())
+    rank = sorted.size();
+  return sorted[rank - 1];
+}
+
+void printFrameStats(const double frame_times[], int count, double total_time)
+{
+  if (count <= 0)
+    return;
+
+  std::vector<double> sorted(frame_times, frame_times + count);
+  std::sort(sorted.begin(), sorted.end());
+
+  double sum = 0.0;
+  for (int i = 0; i < count; i++)
+    sum += frame_times[i];
+
+  printf("Frames: %d in %.3f s\n", count, total_time);
+  printf("Frame time (ms): min %.3f  mean %.3f  p50 %.3f  p95 %.3f  p99 %.3f  max %.3f\n",
+         sorted.front() * 1e3, sum / count * 1e3,
+         percentile(sorted, 50.0) * 1e3, percentile(sorted, 95.0) * 1e3,
+         percentile(sorted, 99.0) * 1e3, sorted.back() * 1e3);
+  printf("Throughput: %.1f frames/s\n", count / total_time);
+}
@@ -0,0 +1,22 @@
+// headless.h: offscreen rendering without a window, for benchmarking on
+// machines with no display (EGL surfaceless context + FBO, Mesa llvmpipe
+// is enough)
+//////////////////////////////////////////////////////////////////////
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+// Creates an EGL surfaceless OpenGL context and makes it current.
+// Must be called before glewInit().
+bool headlessInit();
+
+// Creates and binds the FBO every frame is rendered into (color + depth).
+// Needs the GL entry points, so call it after glewInit().
+bool headlessCreateFramebuffer(int width, int height);
+
+void headlessTerminate();
+
+// Prints min/mean/p50/p95/p99 of the frame times (in seconds) and throughput
+void printFrameStats(const double frame_times[], int count, double total_time);
+
+#endif
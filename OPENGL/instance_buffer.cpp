@@ -0,0 +1,84 @@
+// instance_buffer.cpp
+//////////////////////////////////////////////////////////////////////
+
+#include <stddef.h>
+
+#include "gl_state.h"
+#include "instance_buffer.h"
+
+// The instance attributes starting at instance first
+static void pointAttributes(InstanceBuffer *ib, int first)
+{
+  size_t base = sizeof(InstanceData) * first;
+  glBindBuffer(GL_ARRAY_BUFFER, ib->buffer);
+  for (int c = 0; c < 4; c++)
+    glVertexAttribPointer(ATTRIB_INSTANCE_MODEL + c, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                          (void *)(base + offsetof(InstanceData, model) + sizeof(glm::vec4) * c));
+  for (int c = 0; c < 3; c++)
+    glVertexAttribPointer(ATTRIB_INSTANCE_NORMAL + c, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+                          (void *)(base + offsetof(InstanceData, normal) + sizeof(glm::vec4) * c));
+  glVertexAttribIPointer(ATTRIB_INSTANCE_MATERIAL, 1, GL_UNSIGNED_INT, sizeof(InstanceData),
+                         (void *)(base + offsetof(InstanceData, material)));
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  ib->pointed_first = first;
+}
+
+void instanceBufferCreate(InstanceBuffer *ib, GLuint vao)
+{
+  ib->vao = vao;
+  ib->capacity = INSTANCE_BUFFER_INSTANCES;
+  ib->base_instance = GLEW_VERSION_4_2 || GLEW_ARB_base_instance;
+
+  glGenBuffers(1, &ib->buffer);
+  glBindBuffer(GL_ARRAY_BUFFER, ib->buffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceData) * ib->capacity, NULL, GL_STREAM_DRAW);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  stateBindVertexArray(vao);
+  pointAttributes(ib, 0);
+  for (int a = ATTRIB_INSTANCE_MODEL; a <= ATTRIB_INSTANCE_MATERIAL; a++)
+  {
+    glEnableVertexAttribArray(a);
+    glVertexAttribDivisor(a, 1);
+  }
+  stateBindVertexArray(0);
+}
+
+void instanceBufferDestroy(InstanceBuffer *ib)
+{
+  glDeleteBuffers(1, &ib->buffer);
+  ib->buffer = 0;
+}
+
+void instanceBufferUpload(InstanceBuffer *ib, const InstanceData instances[], int count)
+{
+  while (ib->capacity < count)
+    ib->capacity *= 2;
+
+  // Same buffer name, new storage: the VAO keeps pointing at it
+  glBindBuffer(GL_ARRAY_BUFFER, ib->buffer);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceData) * ib->capacity, NULL, GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(InstanceData) * count, instances);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void drawInstances(InstanceBuffer *ib, const Mesh &mesh, int lod, int first, int count)
+{
+  if (count <= 0)
+    return;
+
+  const MeshLod &level = mesh.lods[lod];
+  const void *offset = (void *)(sizeof(GLuint) * (mesh.first_index + level.first_index));
+  if (ib->base_instance)
+  {
+    glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, level.index_count, GL_UNSIGNED_INT, offset, count,
+                                                  mesh.base_vertex, first);
+    return;
+  }
+
+  // GL 3.3: instance 0 of the draw is wherever the attributes point
+  if (ib->pointed_first != first)
+    pointAttributes(ib, first);
+  glDrawElementsInstancedBaseVertex(GL_TRIANGLES, level.index_count, GL_UNSIGNED_INT, offset, count,
+                                    mesh.base_vertex);
+}
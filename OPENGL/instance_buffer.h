@@ -0,0 +1,61 @@
+// instance_buffer.h: per-object data for instanced draws
+//
+// The model and normal matrices and material of every object drawn in a
+// frame go into one buffer with a single upload, grouped so the instances
+// of each mesh (and level of detail) are contiguous. The geometry heap's
+// VAO reads them as attributes with divisor 1 and one instanced draw
+// covers a whole group; both matrices come cached from the scene graph
+// (scene_graph.h). The draw's base instance picks the
+// group, which is what lets draw_list.h put many groups in one
+// multi-draw (GLSL 3.30 has no gl_DrawID).
+//////////////////////////////////////////////////////////////////////
+
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+// First of the 4 locations of the model matrix, one per column
+#define ATTRIB_INSTANCE_MODEL 3
+// First of the 3 locations of the normal matrix
+#define ATTRIB_INSTANCE_NORMAL 7
+// Index in the Material uniform block (uniform_blocks.h)
+#define ATTRIB_INSTANCE_MATERIAL 10
+
+// Capacity the buffer starts with, it doubles when a frame needs more
+#define INSTANCE_BUFFER_INSTANCES 1024
+
+struct InstanceData
+{
+  glm::mat4 model;
+  glm::vec4 normal[3]; // mat3 columns, w unused
+  GLuint material;
+  GLuint padding[3];
+};
+
+struct InstanceBuffer
+{
+  GLuint buffer;
+  GLuint vao; // the geometry heap's
+  int capacity;
+  bool base_instance; // GL 4.2 base instance draws, else the attributes are re-pointed per group
+  int pointed_first;  // instance the attributes start at without base_instance
+};
+
+// Adds the instance attributes to vao. Needs the GL context.
+void instanceBufferCreate(InstanceBuffer *ib, GLuint vao);
+void instanceBufferDestroy(InstanceBuffer *ib);
+
+// Replaces the contents with count instances. The old storage is
+// orphaned, so the GPU can keep reading last frame's while this one is
+// written.
+void instanceBufferUpload(InstanceBuffer *ib, const InstanceData instances[], int count);
+
+// Draws instances [first, first + count) of the buffer with level lod of
+// mesh. The VAO must be bound.
+void drawInstances(InstanceBuffer *ib, const Mesh &mesh, int lod, int first, int count);
+
+#endif
@@ -0,0 +1,48 @@
+// mapped_file.cpp
+//////////////////////////////////////////////////////////////////////
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "mapped_file.h"
+
+bool mapFile(const char *path, MappedFile *file)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+  {
+    fprintf(stderr, "ERROR: could not open %s\n", path);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0)
+  {
+    fprintf(stderr, "ERROR: %s is empty or unreadable\n", path);
+    close(fd);
+    return false;
+  }
+
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // the mapping keeps the file
+  if (data == MAP_FAILED)
+  {
+    fprintf(stderr, "ERROR: could not map %s\n", path);
+    return false;
+  }
+
+  // Read front to back once
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+
+  file->data = (const char *)data;
+  file->size = st.st_size;
+  return true;
+}
+
+void unmapFile(MappedFile *file)
+{
+  munmap((void *)file->data, file->size);
+}
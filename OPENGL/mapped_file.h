@@ -0,0 +1,20 @@
+// mapped_file.h: read-only memory mapping of a whole file
+//////////////////////////////////////////////////////////////////////
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+
+struct MappedFile
+{
+  const char *data;
+  size_t size;
+};
+
+// Prints the reason and returns false if the file cannot be mapped (empty
+// files included)
+bool mapFile(const char *path, MappedFile *file);
+void unmapFile(MappedFile *file);
+
+#endif
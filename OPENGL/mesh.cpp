@@ -0,0 +1,316 @@
+// mesh.cpp
+//
+// Mesh building and vertex packing
+//
+// A mesh is built in chunks of whole triangles. Each chunk gets its normals
+// and is welded on its own; if there is more than one, their (already
+// welded, so much smaller) vertex lists are welded again and the chunk
+// indices remapped. The result is the same as welding the whole mesh at
+// once: first-occurrence order is kept.
+//////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <glm/gtc/packing.hpp>
+
+#include "mesh.h"
+#include "mesh_lod.h"
+#include "mesh_optimize.h"
+#include "normals.h"
+#include "trace.h"
+
+// Triangles per chunk: small enough to split a big mesh among the cores,
+// big enough that welding twice does not matter
+#define MESH_CHUNK_TRIANGLES 8192
+
+struct MeshChunk
+{
+  std::vector<Vertex> vertices;
+  std::vector<GLuint> indices;
+  GLuint base; // first vertex of the chunk in the concatenated list
+};
+
+// Per thread temporaries, kept from one chunk to the next
+struct ThreadScratch
+{
+  ScratchArena arena = SCRATCH_ARENA_INIT;
+  ~ThreadScratch() { arenaRelease(&arena); }
+};
+
+static thread_local ThreadScratch thread_scratch;
+
+// Welding compares the bits of every float (Vertex has no padding); adding
+// +0 first turns -0 into +0 so both compare (and hash) the same
+static Vertex canonical(const Vertex &v)
+{
+  Vertex c;
+  for (int i = 0; i < 3; i++)
+  {
+    c.position[i] = v.position[i] + 0.0f;
+    c.normal[i] = v.normal[i] + 0.0f;
+  }
+  c.uv[0] = v.uv[0] + 0.0f;
+  c.uv[1] = v.uv[1] + 0.0f;
+  return c;
+}
+
+// FNV-1a over the 8 floats
+static uint32_t hashVertex(const Vertex &v)
+{
+  uint32_t words[sizeof(Vertex) / 4];
+  memcpy(words, &v, sizeof(words));
+  uint64_t h = 14695981039346656037ull;
+  for (size_t i = 0; i < sizeof(words) / 4; i++)
+  {
+    h ^= words[i];
+    h *= 1099511628211ull;
+  }
+  return (uint32_t)(h ^ (h >> 32));
+}
+
+int weldVertices(const Vertex vertices[], int count, Vertex unique[], GLuint indices[], ScratchArena *scratch)
+{
+  // Open addressing, at most half full. Slots hold unique index + 1 (0 = empty).
+  uint32_t table_size = 16;
+  while (table_size < (uint32_t)count * 2)
+    table_size *= 2;
+  uint32_t *table = arenaAllocArray<uint32_t>(scratch, table_size);
+  memset(table, 0, sizeof(uint32_t) * table_size);
+
+  int unique_count = 0;
+  for (int i = 0; i < count; i++)
+  {
+    Vertex key = canonical(vertices[i]);
+    uint32_t slot = hashVertex(key) & (table_size - 1);
+    while (table[slot] != 0 && memcmp(&unique[table[slot] - 1], &key, sizeof(Vertex)) != 0)
+      slot = (slot + 1) & (table_size - 1);
+
+    if (table[slot] == 0)
+    {
+      unique[unique_count] = key;
+      table[slot] = ++unique_count;
+    }
+    indices[i] = table[slot] - 1;
+  }
+
+  return unique_count;
+}
+
+// smooth: normals of the whole mesh, or NULL to compute flat ones here
+static void buildChunk(const MeshSource &source, const GLfloat *smooth, int first, int last, MeshChunk *chunk)
+{
+  TRACE_SCOPE("buildChunk");
+
+  int count = last - first;
+  const GLfloat *positions = source.positions + first * 3;
+  const GLfloat *uvs = source.uvs + first * 2;
+
+  // Normals, triangle list, welded vertices, indices and the weld hash table
+  ScratchArena *scratch = &thread_scratch.arena;
+  arenaReset(scratch);
+  arenaReserve(scratch, sizeof(GLfloat) * count * 3 + sizeof(Vertex) * count * 2 +
+                            sizeof(GLuint) * count + sizeof(uint32_t) * count * 4 + 256);
+
+  const GLfloat *normals = smooth ? smooth + first * 3 : NULL;
+  if (normals == NULL)
+  {
+    // Sin normalizar: el vertex shader ya lo hace
+    GLfloat *flat = arenaAllocArray<GLfloat>(scratch, count * 3);
+    computeFaceNormals(flat, positions, count / 3, false);
+    normals = flat;
+  }
+
+  Vertex *vertices = arenaAllocArray<Vertex>(scratch, count);
+  for (int i = 0; i < count; i++)
+  {
+    vertices[i].position = glm::vec3(positions[i * 3], positions[i * 3 + 1], positions[i * 3 + 2]);
+    vertices[i].normal = glm::vec3(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]);
+    vertices[i].uv = glm::vec2(uvs[i * 2], uvs[i * 2 + 1]);
+  }
+
+  Vertex *unique = arenaAllocArray<Vertex>(scratch, count);
+  chunk->indices.resize(count);
+  int unique_count = weldVertices(vertices, count, unique, chunk->indices.data(), scratch);
+  chunk->vertices.assign(unique, unique + unique_count);
+}
+
+// Last steps, once the whole mesh is welded
+static void finishMesh(const MeshSource &source, MeshData *data)
+{
+  int vertex_count = data->vertices.size(), index_count = data->indices.size();
+  data->cache_before = analyzeVertexCache(data->indices.data(), index_count, vertex_count);
+  ScratchArena *scratch = &thread_scratch.arena;
+  bool overdraw = source.optimize == MESH_OPTIMIZE_OVERDRAW;
+
+  // Simplifying the cache ordered mesh keeps some of that order in the
+  // levels, which makes their own optimization cheaper
+  if (source.optimize != MESH_OPTIMIZE_NONE)
+  {
+    TRACE_SCOPE("optimizeVertexCache");
+    arenaReset(scratch);
+    optimizeVertexCache(data->indices.data(), index_count, vertex_count, data->vertices.data(), overdraw, scratch);
+  }
+
+  {
+    TRACE_SCOPE("buildLods");
+    arenaReset(scratch);
+    data->lod_count = buildLods(data->vertices.data(), vertex_count, data->indices, data->lods,
+                                std::min(std::max(source.lod_levels, 1), MESH_MAX_LODS), scratch);
+  }
+
+  // Fetch order follows the full mesh; the levels only use its vertices
+  if (source.optimize != MESH_OPTIMIZE_NONE)
+  {
+    TRACE_SCOPE("optimizeMesh");
+    for (int l = 1; l < data->lod_count; l++)
+    {
+      arenaReset(scratch);
+      optimizeVertexCache(data->indices.data() + data->lods[l].first_index, data->lods[l].index_count, vertex_count,
+                          data->vertices.data(), overdraw, scratch);
+    }
+    arenaReset(scratch);
+    data->vertices.resize(
+        optimizeVertexFetch(data->vertices.data(), vertex_count, data->indices.data(), data->indices.size(), scratch));
+  }
+  data->cache_after = analyzeVertexCache(data->indices.data(), index_count, data->vertices.size());
+
+  if (data->vertices.empty())
+  {
+    data->bounds_min = data->bounds_max = glm::vec3(0.0f);
+    return;
+  }
+
+  data->bounds_min = data->bounds_max = data->vertices[0].position;
+  for (const Vertex &v : data->vertices)
+  {
+    data->bounds_min = glm::min(data->bounds_min, v.position);
+    data->bounds_max = glm::max(data->bounds_max, v.position);
+  }
+}
+
+void buildMesh(const MeshSource &source, MeshData *data, ThreadPool *pool)
+{
+  TRACE_SCOPE("buildMesh");
+
+  int count = source.size / 3;
+  int chunk_vertices = MESH_CHUNK_TRIANGLES * 3;
+  int chunk_count = (count + chunk_vertices - 1) / chunk_vertices;
+
+  // Smooth normals need the neighbours across chunk borders: done for the
+  // whole mesh first
+  std::vector<GLfloat> smooth;
+  if (source.crease_angle > 0.0f)
+  {
+    TRACE_SCOPE("computeSmoothNormals");
+    smooth.resize(count * 3);
+    arenaReset(&thread_scratch.arena);
+    computeSmoothNormals(smooth.data(), source.positions, count / 3, source.crease_angle, &thread_scratch.arena);
+  }
+
+  std::vector<MeshChunk> chunks(chunk_count > 0 ? chunk_count : 1);
+  parallelFor(pool, chunk_count, 1, [&](int begin, int end) {
+    for (int c = begin; c < end; c++)
+    {
+      int last = (c + 1) * chunk_vertices < count ? (c + 1) * chunk_vertices : count;
+      buildChunk(source, smooth.empty() ? NULL : smooth.data(), c * chunk_vertices, last, &chunks[c]);
+    }
+  });
+
+  if (chunk_count <= 1)
+  {
+    data->vertices.swap(chunks[0].vertices);
+    data->indices.swap(chunks[0].indices);
+    finishMesh(source, data);
+    return;
+  }
+
+  // Weld the chunks together: remap[k] is the final index of vertex k of
+  // the concatenated chunk vertex lists
+  std::vector<Vertex> joined;
+  for (MeshChunk &chunk : chunks)
+  {
+    chunk.base = joined.size();
+    joined.insert(joined.end(), chunk.vertices.begin(), chunk.vertices.end());
+  }
+
+  std::vector<GLuint> remap(joined.size());
+  data->vertices.resize(joined.size());
+  ScratchArena *scratch = &thread_scratch.arena;
+  arenaReset(scratch);
+  int unique_count = weldVertices(joined.data(), joined.size(), data->vertices.data(), remap.data(), scratch);
+  data->vertices.resize(unique_count);
+
+  data->indices.resize(count);
+  parallelFor(pool, chunk_count, 1, [&](int begin, int end) {
+    for (int c = begin; c < end; c++)
+    {
+      GLuint *out = data->indices.data() + c * chunk_vertices;
+      for (size_t i = 0; i < chunks[c].indices.size(); i++)
+        out[i] = remap[chunks[c].base + chunks[c].indices[i]];
+    }
+  });
+
+  finishMesh(source, data);
+}
+
+void buildMeshes(const MeshSource sources[], int count, MeshData data[], ThreadPool *pool)
+{
+  parallelFor(pool, count, 1, [&](int begin, int end) {
+    for (int i = begin; i < end; i++)
+      buildMesh(sources[i], &data[i], pool);
+  });
+}
+
+// Octahedral mapping: the unit sphere projected on the |x|+|y|+|z| = 1
+// octahedron, lower half folded over the upper one into the [-1, 1] square
+static glm::vec2 octahedralEncode(glm::vec3 n)
+{
+  float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+  if (l1 == 0.0f)
+    return glm::vec2(0.0f);
+  glm::vec2 e(n.x / l1, n.y / l1);
+  if (n.z < 0.0f)
+    e = glm::vec2((1.0f - fabsf(e.y)) * (e.x >= 0.0f ? 1.0f : -1.0f), (1.0f - fabsf(e.x)) * (e.y >= 0.0f ? 1.0f : -1.0f));
+  return e;
+}
+
+void packVertices(const Vertex vertices[], int count, PackedVertex packed[], glm::vec3 *offset, glm::vec3 *scale)
+{
+  glm::vec3 low(0.0f), high(0.0f);
+  if (count > 0)
+    low = high = vertices[0].position;
+  for (int i = 1; i < count; i++)
+  {
+    low = glm::min(low, vertices[i].position);
+    high = glm::max(high, vertices[i].position);
+  }
+
+  // Flat dimensions get scale 0 and every value decodes to the offset
+  *offset = low;
+  *scale = high - low;
+  glm::vec3 inverse(0.0f);
+  for (int j = 0; j < 3; j++)
+    if ((*scale)[j] > 0.0f)
+      inverse[j] = 1.0f / (*scale)[j];
+
+  for (int i = 0; i < count; i++)
+  {
+    const Vertex &v = vertices[i];
+    PackedVertex &p = packed[i];
+    for (int j = 0; j < 3; j++)
+      p.position[j] = glm::packUnorm1x16((v.position[j] - low[j]) * inverse[j]);
+    p.position[3] = 0;
+
+    glm::vec2 e = octahedralEncode(v.normal);
+    p.normal[0] = (GLshort)glm::packSnorm1x16(e.x);
+    p.normal[1] = (GLshort)glm::packSnorm1x16(e.y);
+
+    p.uv[0] = glm::packHalf1x16(v.uv.x);
+    p.uv[1] = glm::packHalf1x16(v.uv.y);
+  }
+}
@@ -0,0 +1,133 @@
+// mesh.h: vertex formats, mesh building and GPU upload of the meshes
+// created by calcPolygons()
+//
+// Building (normals, welding, indices, bounds) is plain CPU work that runs
+// on the thread pool; only the upload to the geometry heap
+// (geometry_heap.h) needs the GL context.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef MESH_H
+#define MESH_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "arena.h"
+#include "thread_pool.h"
+
+// Vertex attributes, same locations for every layout
+#define ATTRIB_POSITION 0
+#define ATTRIB_NORMAL 1
+#define ATTRIB_TEXCOORD 2
+
+// One vertex of the interleaved layout: a single fetch gets everything
+struct Vertex
+{
+  glm::vec3 position;
+  glm::vec3 normal;
+  glm::vec2 uv;
+};
+
+// Half the size of Vertex. The vertex shader decodes it with the mesh's
+// position_offset / position_scale and octahedral_normals uniforms.
+struct PackedVertex
+{
+  GLushort position[4]; // unorm16 inside the mesh bounds; [3] is padding
+  GLshort normal[2];    // octahedral, snorm16
+  GLushort uv[2];       // half float
+};
+
+enum VertexLayout
+{
+  VERTEX_LAYOUT_INTERLEAVED, // one VBO of Vertex, one stride (default)
+  VERTEX_LAYOUT_SEPARATE,    // one VBO per attribute
+  VERTEX_LAYOUT_PACKED       // one VBO of PackedVertex
+};
+
+// Most levels of detail of a mesh, the full one included
+#define MESH_MAX_LODS 5
+
+// One level of detail: a range of the mesh's indices
+struct MeshLod
+{
+  GLuint first_index;
+  GLsizei index_count;
+  float error; // largest distance a surface point moved, in mesh units
+};
+
+// A mesh in the geometry heap: its indices start at first_index of the
+// heap's element buffer and count from base_vertex
+struct Mesh
+{
+  GLint base_vertex;
+  GLuint first_index;
+  GLsizei vertex_count;
+  GLsizei index_count; // GL_UNSIGNED_INT indices, all levels
+
+  // Position = attribute * scale + offset (0 and 1 unless packed)
+  glm::vec3 position_offset, position_scale;
+
+  glm::vec3 bounds_min, bounds_max;
+  int lod_count; // lods[0] is the full mesh
+  MeshLod lods[MESH_MAX_LODS];
+};
+
+enum MeshOptimize
+{
+  MESH_OPTIMIZE_NONE,
+  MESH_OPTIMIZE_CACHE,   // triangles for the vertex cache, vertices for fetch (default)
+  MESH_OPTIMIZE_OVERDRAW // same, with clusters sorted to reduce overdraw
+};
+
+// Post-transform vertex cache behaviour of an index buffer (mesh_optimize.h)
+struct VertexCacheStats
+{
+  float acmr; // vertex shader runs per triangle (0.5 is ideal on big meshes, 3 is worst)
+  float atvr; // vertex shader runs per referenced vertex (1 is ideal)
+};
+
+// Input of buildMesh(): a triangle list, 3 floats per vertex in positions
+// (size floats in total) and 2 per vertex in uvs
+struct MeshSource
+{
+  const GLfloat *positions;
+  const GLfloat *uvs;
+  int size;
+  float crease_angle; // degrees; 0 = flat normals, else computeSmoothNormals()
+  MeshOptimize optimize;
+  int lod_levels; // levels of detail to build (mesh_lod.h), 1 = only the full mesh
+};
+
+// Output of buildMesh(), ready for geometryHeapUpload()
+struct MeshData
+{
+  std::vector<Vertex> vertices; // welded
+  std::vector<GLuint> indices;  // one per input vertex, then the coarser levels
+  glm::vec3 bounds_min, bounds_max;
+  VertexCacheStats cache_before, cache_after; // of the welded mesh, before and after optimizing
+  int lod_count;
+  MeshLod lods[MESH_MAX_LODS];
+};
+
+// Merges identical (position, normal, uv) tuples of a triangle list.
+// unique gets one copy of each, indices one entry per input vertex (both
+// must have room for count). The hash table comes from scratch. Returns
+// the number of unique vertices.
+int weldVertices(const Vertex vertices[], int count, Vertex unique[], GLuint indices[], ScratchArena *scratch);
+
+// Normals, welding, indices, levels of detail, vertex cache optimization
+// and bounds of one mesh. Meshes bigger than a chunk are split and their chunks built in
+// parallel on pool (which may be NULL). Does not touch GL: safe on any
+// thread.
+void buildMesh(const MeshSource &source, MeshData *data, ThreadPool *pool);
+
+// buildMesh() of count meshes, spread over pool
+void buildMeshes(const MeshSource sources[], int count, MeshData data[], ThreadPool *pool);
+
+// Quantizes positions to the bounds of the vertices (written to offset and
+// scale), encodes normals as octahedral and uvs as half floats
+void packVertices(const Vertex vertices[], int count, PackedVertex packed[], glm::vec3 *offset, glm::vec3 *scale);
+
+#endif
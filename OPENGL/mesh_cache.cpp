@@ -0,0 +1,266 @@
+// mesh_cache.cpp
+//
+// File layout (host byte order):
+//   MeshCacheHeader
+//   Vertex[vertex_count] at vertex_offset
+//   GLuint[index_count] at index_offset, every level of detail
+// Both offsets are multiples of 64 so the arrays are aligned in the map.
+//////////////////////////////////////////////////////////////////////
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "mesh_cache.h"
+#include "trace.h"
+
+#define MESH_CACHE_HASH_BLOCK (1 << 20)
+
+struct MeshCacheHeader
+{
+  char magic[8]; // "MESHCACH"
+  uint32_t version;
+  uint32_t vertex_size; // sizeof(Vertex) when written
+  uint64_t key;
+  uint32_t vertex_count;
+  uint32_t index_count;
+  float bounds_min[3];
+  float bounds_max[3];
+  uint64_t vertex_offset;
+  uint64_t index_offset;
+  uint32_t lod_count;
+  uint32_t lod_first[MESH_MAX_LODS];
+  uint32_t lod_index_count[MESH_MAX_LODS];
+  float lod_error[MESH_MAX_LODS];
+};
+
+static const char mesh_cache_magic[8] = {'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H'};
+
+static uint64_t mix64(uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+static uint64_t rotl64(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+// 4 independent lanes of 8 bytes so the multiplies overlap
+static uint64_t hashBlock(const unsigned char *p, size_t size, uint64_t seed)
+{
+  const uint64_t k1 = 0x9e3779b97f4a7c15ull, k2 = 0xc2b2ae3d27d4eb4full;
+  uint64_t lanes[4] = {seed, seed + k1, seed + k2, seed - k1};
+
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32)
+    for (int l = 0; l < 4; l++)
+    {
+      uint64_t w;
+      memcpy(&w, p + i + l * 8, 8);
+      lanes[l] = rotl64(lanes[l] + w * k2, 31) * k1;
+    }
+
+  // Tail: whole words, then the last bytes zero padded
+  for (; i + 8 <= size; i += 8)
+  {
+    uint64_t w;
+    memcpy(&w, p + i, 8);
+    lanes[0] = rotl64(lanes[0] + w * k2, 31) * k1;
+  }
+  if (i < size)
+  {
+    uint64_t w = 0;
+    memcpy(&w, p + i, size - i);
+    lanes[1] = rotl64(lanes[1] + w * k2, 31) * k1;
+  }
+
+  uint64_t h = size;
+  for (int l = 0; l < 4; l++)
+    h = mix64(h ^ lanes[l]);
+  return h;
+}
+
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed, ThreadPool *pool)
+{
+  const unsigned char *p = (const unsigned char *)data;
+  size_t blocks = (size + MESH_CACHE_HASH_BLOCK - 1) / MESH_CACHE_HASH_BLOCK;
+
+  std::vector<uint64_t> block_hash(blocks);
+  parallelFor(pool, blocks, 4, [&](int begin, int end) {
+    for (int b = begin; b < end; b++)
+    {
+      size_t offset = (size_t)b * MESH_CACHE_HASH_BLOCK;
+      size_t n = size - offset < MESH_CACHE_HASH_BLOCK ? size - offset : MESH_CACHE_HASH_BLOCK;
+      block_hash[b] = hashBlock(p + offset, n, seed + b);
+    }
+  });
+
+  uint64_t h = mix64(seed ^ size);
+  for (uint64_t bh : block_hash)
+    h = mix64(h ^ bh);
+  return h;
+}
+
+// Everything besides the input that changes what buildMesh() makes
+static uint64_t buildSeed(const MeshSource &options, uint64_t salt)
+{
+  uint32_t crease_bits;
+  memcpy(&crease_bits, &options.crease_angle, sizeof(crease_bits));
+  uint64_t h = mix64(MESH_CACHE_VERSION ^ ((uint64_t)sizeof(Vertex) << 32));
+  h = mix64(h ^ crease_bits ^ ((uint64_t)options.optimize << 32));
+  h = mix64(h ^ (uint64_t)options.lod_levels);
+  return mix64(h ^ salt);
+}
+
+uint64_t meshSourceKey(const MeshSource &source, ThreadPool *pool)
+{
+  uint64_t h = buildSeed(source, 1);
+  h = hashBytes(source.positions, sizeof(GLfloat) * source.size, h, pool);
+  h = hashBytes(source.uvs, sizeof(GLfloat) * (source.size / 3) * 2, h, pool);
+  return h;
+}
+
+bool meshFileKey(const char *path, const MeshSource &options, ThreadPool *pool, uint64_t *key)
+{
+  TRACE_SCOPE("meshFileKey");
+
+  MappedFile file;
+  if (!mapFile(path, &file))
+    return false;
+  *key = hashBytes(file.data, file.size, buildSeed(options, 2), pool);
+  unmapFile(&file);
+  return true;
+}
+
+static void cachePath(const char *dir, uint64_t key, char *path, size_t size)
+{
+  snprintf(path, size, "%s/%016llx.mesh", dir, (unsigned long long)key);
+}
+
+static uint64_t align64(uint64_t offset)
+{
+  return (offset + 63) & ~(uint64_t)63;
+}
+
+bool meshCacheOpen(const char *dir, uint64_t key, CachedMesh *mesh)
+{
+  TRACE_SCOPE("meshCacheOpen");
+
+  char path[1024];
+  cachePath(dir, key, path, sizeof(path));
+  if (access(path, R_OK) != 0 || !mapFile(path, &mesh->file))
+    return false;
+
+  MeshCacheHeader header;
+  bool valid = mesh->file.size >= sizeof(header);
+  if (valid)
+  {
+    memcpy(&header, mesh->file.data, sizeof(header));
+    valid = memcmp(header.magic, mesh_cache_magic, sizeof(header.magic)) == 0 &&
+            header.version == MESH_CACHE_VERSION && header.vertex_size == sizeof(Vertex) && header.key == key &&
+            header.vertex_offset % 64 == 0 && header.index_offset % 64 == 0 &&
+            header.vertex_offset + (uint64_t)header.vertex_count * sizeof(Vertex) <= mesh->file.size &&
+            header.index_offset + (uint64_t)header.index_count * sizeof(GLuint) <= mesh->file.size &&
+            header.lod_count >= 1 && header.lod_count <= MESH_MAX_LODS;
+    for (uint32_t l = 0; valid && l < header.lod_count; l++)
+      valid = (uint64_t)header.lod_first[l] + header.lod_index_count[l] <= header.index_count;
+  }
+  if (!valid)
+  {
+    fprintf(stderr, "Mesh cache: ignoring stale or damaged %s\n", path);
+    unmapFile(&mesh->file);
+    return false;
+  }
+
+  mesh->vertices = (const Vertex *)(mesh->file.data + header.vertex_offset);
+  mesh->indices = (const GLuint *)(mesh->file.data + header.index_offset);
+  mesh->vertex_count = header.vertex_count;
+  mesh->index_count = header.index_count;
+  mesh->bounds_min = glm::vec3(header.bounds_min[0], header.bounds_min[1], header.bounds_min[2]);
+  mesh->bounds_max = glm::vec3(header.bounds_max[0], header.bounds_max[1], header.bounds_max[2]);
+  mesh->lod_count = header.lod_count;
+  for (uint32_t l = 0; l < header.lod_count; l++)
+  {
+    mesh->lods[l].first_index = header.lod_first[l];
+    mesh->lods[l].index_count = header.lod_index_count[l];
+    mesh->lods[l].error = header.lod_error[l];
+  }
+  return true;
+}
+
+void meshCacheClose(CachedMesh *mesh)
+{
+  unmapFile(&mesh->file);
+}
+
+bool meshCacheWrite(const char *dir, uint64_t key, const MeshData &data)
+{
+  TRACE_SCOPE("meshCacheWrite");
+
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+  {
+    fprintf(stderr, "ERROR: could not create mesh cache directory %s\n", dir);
+    return false;
+  }
+
+  MeshCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, mesh_cache_magic, sizeof(header.magic));
+  header.version = MESH_CACHE_VERSION;
+  header.vertex_size = sizeof(Vertex);
+  header.key = key;
+  header.vertex_count = data.vertices.size();
+  header.index_count = data.indices.size();
+  for (int i = 0; i < 3; i++)
+  {
+    header.bounds_min[i] = data.bounds_min[i];
+    header.bounds_max[i] = data.bounds_max[i];
+  }
+  header.lod_count = data.lod_count;
+  for (int l = 0; l < data.lod_count; l++)
+  {
+    header.lod_first[l] = data.lods[l].first_index;
+    header.lod_index_count[l] = data.lods[l].index_count;
+    header.lod_error[l] = data.lods[l].error;
+  }
+  header.vertex_offset = align64(sizeof(header));
+  header.index_offset = align64(header.vertex_offset + sizeof(Vertex) * data.vertices.size());
+
+  char path[1024], temp[1040];
+  cachePath(dir, key, path, sizeof(path));
+  snprintf(temp, sizeof(temp), "%s.%d.tmp", path, (int)getpid());
+
+  FILE *f = fopen(temp, "wb");
+  if (f == NULL)
+  {
+    fprintf(stderr, "ERROR: could not write %s\n", temp);
+    return false;
+  }
+
+  static const char zeros[64] = {0};
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+            fwrite(zeros, 1, header.vertex_offset - sizeof(header), f) == header.vertex_offset - sizeof(header) &&
+            fwrite(data.vertices.data(), sizeof(Vertex), data.vertices.size(), f) == data.vertices.size();
+  uint64_t written = header.vertex_offset + sizeof(Vertex) * data.vertices.size();
+  ok = ok && fwrite(zeros, 1, header.index_offset - written, f) == header.index_offset - written &&
+       fwrite(data.indices.data(), sizeof(GLuint), data.indices.size(), f) == data.indices.size();
+  ok = fclose(f) == 0 && ok;
+
+  if (!ok || rename(temp, path) != 0)
+  {
+    fprintf(stderr, "ERROR: could not write %s\n", path);
+    unlink(temp);
+    return false;
+  }
+  return true;
+}
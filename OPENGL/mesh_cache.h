@@ -0,0 +1,51 @@
+// mesh_cache.h: built meshes stored on disk, keyed by a hash of their input
+//
+// A cache file is a header followed by the vertex and index arrays exactly
+// as geometryHeapUpload() sends them to the GPU, so a hit maps the file
+// and hands the pointers to glBufferSubData() with no parsing or building.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <stdint.h>
+
+#include "mapped_file.h"
+#include "mesh.h"
+#include "thread_pool.h"
+
+// Bump when the file layout or the output of buildMesh() changes: old
+// files then stop matching and get rebuilt
+#define MESH_CACHE_VERSION 2
+
+struct CachedMesh
+{
+  MappedFile file;
+  const Vertex *vertices;
+  const GLuint *indices;
+  int vertex_count, index_count;
+  glm::vec3 bounds_min, bounds_max;
+  int lod_count;
+  MeshLod lods[MESH_MAX_LODS];
+};
+
+// 64-bit hash of size bytes, hashed in parallel blocks on pool (may be NULL)
+uint64_t hashBytes(const void *data, size_t size, uint64_t seed, ThreadPool *pool);
+
+// Key of the mesh buildMesh() would make from source
+uint64_t meshSourceKey(const MeshSource &source, ThreadPool *pool);
+
+// Key of the mesh importMesh() + buildMesh() would make from a model file
+// with the build options of options (its arrays are not used). Hashes the
+// raw file, so a hit does not even need the import.
+bool meshFileKey(const char *path, const MeshSource &options, ThreadPool *pool, uint64_t *key);
+
+// false if there is no valid file for key in dir
+bool meshCacheOpen(const char *dir, uint64_t key, CachedMesh *mesh);
+void meshCacheClose(CachedMesh *mesh);
+
+// Creates dir if needed. Written to a temporary name and renamed, so
+// readers never see a partial file.
+bool meshCacheWrite(const char *dir, uint64_t key, const MeshData &data);
+
+#endif
@@ -0,0 +1,745 @@
+// mesh_import.cpp
+//
+// OBJ: the text is cut into ~1 MB chunks at line breaks. Each chunk parses
+// its v / vt / f lines on its own; face indices that are relative (< 0)
+// are kept chunk-local until the prefix sums of v and vt counts are known.
+// A second parallel pass copies positions and uvs to every corner.
+//
+// PLY: the vertex records have a fixed size, so they are decoded in
+// parallel ranges. Faces are lists; one serial scan finds where each block
+// of faces starts, then blocks are fanned into triangles in parallel.
+//////////////////////////////////////////////////////////////////////
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <string>
+
+#include "mapped_file.h"
+#include "mesh_import.h"
+#include "trace.h"
+
+#define OBJ_CHUNK_BYTES (1 << 20)
+#define PLY_FACE_BLOCK 65536
+
+// Powers of ten that are exact in a double
+static const double exact_pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Copies the token to a terminated buffer (the mapping has no final '\0')
+static const char *parseFloatSlow(const char *s, const char *end, float *value)
+{
+  char buffer[64];
+  size_t n = 0;
+  while (s + n < end && n < sizeof(buffer) - 1 && s[n] != ' ' && s[n] != '\t' && s[n] != '\n' &&
+         s[n] != '\r' && s[n] != '/')
+  {
+    buffer[n] = s[n];
+    n++;
+  }
+  buffer[n] = '\0';
+
+  char *stop;
+  *value = strtof(buffer, &stop);
+  return s + (stop - buffer);
+}
+
+const char *parseFloat(const char *s, const char *end, float *value)
+{
+  const char *p = s;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+    negative = *p++ == '-';
+
+  uint64_t mantissa = 0;
+  int digits = 0;   // significant digits in mantissa
+  int exponent = 0; // of 10
+  bool any = false;
+
+  for (; p < end && *p >= '0' && *p <= '9'; p++)
+  {
+    any = true;
+    if (digits < 19)
+    {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits += mantissa != 0;
+    }
+    else
+      exponent++;
+  }
+  if (p < end && *p == '.')
+  {
+    for (p++; p < end && *p >= '0' && *p <= '9'; p++)
+    {
+      any = true;
+      if (digits < 19)
+      {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += mantissa != 0;
+        exponent--;
+      }
+    }
+  }
+  if (!any)
+    return parseFloatSlow(s, end, value); // nan, inf or nothing
+
+  if (p < end && (*p == 'e' || *p == 'E'))
+  {
+    const char *q = p + 1;
+    bool exp_negative = false;
+    if (q < end && (*q == '-' || *q == '+'))
+      exp_negative = *q++ == '-';
+    if (q < end && *q >= '0' && *q <= '9')
+    {
+      int e = 0;
+      for (; q < end && *q >= '0' && *q <= '9'; q++)
+        if (e < 10000)
+          e = e * 10 + (*q - '0');
+      exponent += exp_negative ? -e : e;
+      p = q;
+    }
+  }
+
+  if (mantissa > (1ull << 53) || exponent < -22 || exponent > 22)
+    return parseFloatSlow(s, end, value);
+
+  double v = (double)mantissa;
+  v = exponent < 0 ? v / exact_pow10[-exponent] : v * exact_pow10[exponent];
+  *value = (float)(negative ? -v : v);
+  return p;
+}
+
+// -------------------------------------------------------------------------
+// OBJ
+
+// Relative (negative) indices are stored as a chunk-local 0-based index
+// and flagged until the chunk offsets are known
+#define CORNER_V_LOCAL 1
+#define CORNER_VT_LOCAL 2
+
+struct ObjCorner
+{
+  int32_t v, vt; // 1-based absolute (vt 0 = none) or chunk-local
+  uint32_t flags;
+};
+
+struct ObjChunk
+{
+  const char *begin, *end;
+  std::vector<GLfloat> positions, uvs;
+  std::vector<ObjCorner> corners; // 3 per triangle
+  size_t v_offset, vt_offset, corner_offset;
+  const char *error; // NULL or the line that failed
+};
+
+static const char *skipSpaces(const char *p, const char *end)
+{
+  while (p < end && (*p == ' ' || *p == '\t'))
+    p++;
+  return p;
+}
+
+static const char *nextLine(const char *p, const char *end)
+{
+  const char *nl = (const char *)memchr(p, '\n', end - p);
+  return nl ? nl + 1 : end;
+}
+
+static const char *parseInt(const char *p, const char *end, int32_t *value)
+{
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+'))
+    negative = *p++ == '-';
+  const char *digits = p;
+  int64_t v = 0;
+  for (; p < end && *p >= '0' && *p <= '9'; p++)
+    if (v < INT32_MAX)
+      v = v * 10 + (*p - '0');
+  if (p == digits)
+    return NULL;
+  *value = (int32_t)(negative ? -v : v);
+  return p;
+}
+
+// Reads "v", "v/vt", "v//vn" or "v/vt/vn". Returns NULL if malformed.
+static const char *parseCorner(const char *p, const char *end, const ObjChunk &chunk, ObjCorner *corner)
+{
+  int32_t v, vt = 0, vn;
+  p = parseInt(p, end, &v);
+  if (p == NULL || v == 0)
+    return NULL;
+
+  if (p < end && *p == '/')
+  {
+    p++;
+    if (p < end && *p != '/')
+    {
+      p = parseInt(p, end, &vt);
+      if (p == NULL || vt == 0)
+        return NULL;
+    }
+    if (p < end && *p == '/')
+    {
+      p = parseInt(p + 1, end, &vn); // normals are recomputed
+      if (p == NULL)
+        return NULL;
+    }
+  }
+
+  corner->flags = 0;
+  corner->v = v;
+  corner->vt = vt;
+  if (v < 0)
+  {
+    corner->v = (int32_t)(chunk.positions.size() / 3) + v;
+    corner->flags |= CORNER_V_LOCAL;
+  }
+  if (vt < 0)
+  {
+    corner->vt = (int32_t)(chunk.uvs.size() / 2) + vt;
+    corner->flags |= CORNER_VT_LOCAL;
+  }
+  return p;
+}
+
+static void parseObjChunk(ObjChunk *chunk)
+{
+  TRACE_SCOPE("parseObjChunk");
+
+  const char *end = chunk->end;
+  ObjCorner polygon[3]; // first, previous and current corner of the fan
+
+  for (const char *line = chunk->begin; line < end; line = nextLine(line, end))
+  {
+    const char *p = skipSpaces(line, end);
+    if (end - p < 2)
+      continue;
+
+    if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+    {
+      p += 2;
+      for (int i = 0; i < 3; i++)
+      {
+        float x;
+        const char *q = skipSpaces(p, end);
+        p = parseFloat(q, end, &x);
+        if (p == q)
+        {
+          chunk->error = line;
+          return;
+        }
+        chunk->positions.push_back(x);
+      }
+    }
+    else if (p[0] == 'v' && p[1] == 't' && end - p > 2 && (p[2] == ' ' || p[2] == '\t'))
+    {
+      p += 3;
+      for (int i = 0; i < 2; i++)
+      {
+        float x = 0.0f;
+        p = parseFloat(skipSpaces(p, end), end, &x); // a missing v reads as 0
+        chunk->uvs.push_back(x);
+      }
+    }
+    else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+    {
+      // Fan: (0, 1, 2), (0, 2, 3), ...
+      int n = 0;
+      for (p = skipSpaces(p + 2, end); p < end && *p != '\n' && *p != '\r' && *p != '#'; p = skipSpaces(p, end))
+      {
+        p = parseCorner(p, end, *chunk, &polygon[n < 2 ? n : 2]);
+        if (p == NULL)
+        {
+          chunk->error = line;
+          return;
+        }
+        if (++n >= 3)
+        {
+          chunk->corners.insert(chunk->corners.end(), polygon, polygon + 3);
+          polygon[1] = polygon[2];
+        }
+      }
+      if (n < 3)
+      {
+        chunk->error = line;
+        return;
+      }
+    }
+  }
+}
+
+// Absolute 0-based index of a corner attribute, or -1 if out of range
+static int64_t resolveIndex(int32_t index, bool local, size_t offset, size_t count)
+{
+  int64_t i = local ? (int64_t)offset + index : (int64_t)index - 1;
+  return i >= 0 && i < (int64_t)count ? i : -1;
+}
+
+static bool importObj(const MappedFile &file, ImportedMesh *mesh, ThreadPool *pool)
+{
+  TRACE_SCOPE("importObj");
+
+  const char *data = file.data;
+  const char *end = data + file.size;
+
+  // Chunk boundaries right after a line break
+  std::vector<ObjChunk> chunks;
+  for (const char *begin = data; begin < end;)
+  {
+    const char *split = end - begin > OBJ_CHUNK_BYTES ? nextLine(begin + OBJ_CHUNK_BYTES, end) : end;
+    ObjChunk chunk;
+    chunk.begin = begin;
+    chunk.end = split;
+    chunk.error = NULL;
+    chunks.push_back(chunk);
+    begin = split;
+  }
+
+  parallelFor(pool, chunks.size(), 1, [&](int begin, int end) {
+    for (int c = begin; c < end; c++)
+      parseObjChunk(&chunks[c]);
+  });
+
+  size_t v_count = 0, vt_count = 0, corner_count = 0;
+  for (ObjChunk &chunk : chunks)
+  {
+    if (chunk.error)
+    {
+      const char *eol = nextLine(chunk.error, end);
+      fprintf(stderr, "ERROR: bad OBJ line at byte %zu: %.*s\n", (size_t)(chunk.error - data),
+              (int)(eol - chunk.error > 80 ? 80 : eol - chunk.error), chunk.error);
+      return false;
+    }
+    chunk.v_offset = v_count;
+    chunk.vt_offset = vt_count;
+    chunk.corner_offset = corner_count;
+    v_count += chunk.positions.size() / 3;
+    vt_count += chunk.uvs.size() / 2;
+    corner_count += chunk.corners.size();
+  }
+
+  // Every chunk's vertices in one array so corners can reach any of them
+  std::vector<GLfloat> positions(v_count * 3), uvs(vt_count * 2);
+  parallelFor(pool, chunks.size(), 1, [&](int begin, int end) {
+    for (int c = begin; c < end; c++)
+    {
+      std::copy(chunks[c].positions.begin(), chunks[c].positions.end(), positions.begin() + chunks[c].v_offset * 3);
+      std::copy(chunks[c].uvs.begin(), chunks[c].uvs.end(), uvs.begin() + chunks[c].vt_offset * 2);
+    }
+  });
+
+  mesh->positions.resize(corner_count * 3);
+  mesh->uvs.resize(corner_count * 2);
+  std::vector<char> bad(chunks.size(), 0);
+  parallelFor(pool, chunks.size(), 1, [&](int begin, int end) {
+    for (int c = begin; c < end; c++)
+    {
+      const ObjChunk &chunk = chunks[c];
+      GLfloat *out_pos = mesh->positions.data() + chunk.corner_offset * 3;
+      GLfloat *out_uv = mesh->uvs.data() + chunk.corner_offset * 2;
+      for (size_t k = 0; k < chunk.corners.size(); k++)
+      {
+        const ObjCorner &corner = chunk.corners[k];
+        int64_t v = resolveIndex(corner.v, corner.flags & CORNER_V_LOCAL, chunk.v_offset, v_count);
+        if (v < 0)
+        {
+          bad[c] = 1;
+          break;
+        }
+        memcpy(out_pos + k * 3, &positions[v * 3], sizeof(GLfloat) * 3);
+
+        out_uv[k * 2] = out_uv[k * 2 + 1] = 0.0f;
+        if (corner.vt != 0 || (corner.flags & CORNER_VT_LOCAL))
+        {
+          int64_t vt = resolveIndex(corner.vt, corner.flags & CORNER_VT_LOCAL, chunk.vt_offset, vt_count);
+          if (vt < 0)
+          {
+            bad[c] = 1;
+            break;
+          }
+          memcpy(out_uv + k * 2, &uvs[vt * 2], sizeof(GLfloat) * 2);
+        }
+      }
+    }
+  });
+
+  for (size_t c = 0; c < chunks.size(); c++)
+    if (bad[c])
+    {
+      fprintf(stderr, "ERROR: OBJ face index out of range (%zu v, %zu vt)\n", v_count, vt_count);
+      return false;
+    }
+
+  return true;
+}
+
+// -------------------------------------------------------------------------
+// PLY (binary, either endianness)
+
+enum PlyType
+{
+  PLY_INVALID,
+  PLY_INT8,
+  PLY_UINT8,
+  PLY_INT16,
+  PLY_UINT16,
+  PLY_INT32,
+  PLY_UINT32,
+  PLY_FLOAT32,
+  PLY_FLOAT64
+};
+
+struct PlyProperty
+{
+  std::string name;
+  PlyType type;
+  PlyType count_type; // PLY_INVALID unless it is a list
+  size_t offset;      // in the record, for fixed size records
+};
+
+struct PlyElement
+{
+  std::string name;
+  size_t count;
+  std::vector<PlyProperty> properties;
+  size_t record_size; // 0 if it has lists
+};
+
+static PlyType plyType(const std::string &name)
+{
+  static const struct
+  {
+    const char *name;
+    PlyType type;
+  } types[] = {{"char", PLY_INT8},     {"int8", PLY_INT8},       {"uchar", PLY_UINT8},   {"uint8", PLY_UINT8},
+               {"short", PLY_INT16},   {"int16", PLY_INT16},     {"ushort", PLY_UINT16}, {"uint16", PLY_UINT16},
+               {"int", PLY_INT32},     {"int32", PLY_INT32},     {"uint", PLY_UINT32},   {"uint32", PLY_UINT32},
+               {"float", PLY_FLOAT32}, {"float32", PLY_FLOAT32}, {"double", PLY_FLOAT64}, {"float64", PLY_FLOAT64}};
+  for (const auto &t : types)
+    if (name == t.name)
+      return t.type;
+  return PLY_INVALID;
+}
+
+static size_t plyTypeSize(PlyType type)
+{
+  static const size_t sizes[] = {0, 1, 1, 2, 2, 4, 4, 4, 8};
+  return sizes[type];
+}
+
+static double plyRead(const unsigned char *p, PlyType type, bool swap)
+{
+  unsigned char b[8];
+  size_t size = plyTypeSize(type);
+  for (size_t i = 0; i < size; i++)
+    b[i] = swap ? p[size - 1 - i] : p[i];
+
+  switch (type)
+  {
+  case PLY_INT8: return (int8_t)b[0];
+  case PLY_UINT8: return b[0];
+  case PLY_INT16: { int16_t v; memcpy(&v, b, 2); return v; }
+  case PLY_UINT16: { uint16_t v; memcpy(&v, b, 2); return v; }
+  case PLY_INT32: { int32_t v; memcpy(&v, b, 4); return v; }
+  case PLY_UINT32: { uint32_t v; memcpy(&v, b, 4); return v; }
+  case PLY_FLOAT32: { float v; memcpy(&v, b, 4); return v; }
+  case PLY_FLOAT64: { double v; memcpy(&v, b, 8); return v; }
+  default: return 0.0;
+  }
+}
+
+// Start of the record after p, NULL if it runs past end
+static const unsigned char *plySkipRecord(const PlyElement &element, const unsigned char *p, const unsigned char *end,
+                                          bool swap)
+{
+  if (element.record_size)
+    return end - p >= (ptrdiff_t)element.record_size ? p + element.record_size : NULL;
+
+  for (const PlyProperty &prop : element.properties)
+  {
+    if (prop.count_type == PLY_INVALID)
+      p += plyTypeSize(prop.type);
+    else
+    {
+      if (end - p < (ptrdiff_t)plyTypeSize(prop.count_type))
+        return NULL;
+      size_t n = (size_t)plyRead(p, prop.count_type, swap);
+      p += plyTypeSize(prop.count_type) + n * plyTypeSize(prop.type);
+    }
+    if (p > end)
+      return NULL;
+  }
+  return p;
+}
+
+// Start of the list property prop inside a record already known to be
+// complete (lists before it have to be walked)
+static const unsigned char *plyListStart(const PlyElement &element, const PlyProperty *prop,
+                                         const unsigned char *record, bool swap)
+{
+  const unsigned char *p = record;
+  for (const PlyProperty &before : element.properties)
+  {
+    if (&before == prop)
+      break;
+    if (before.count_type == PLY_INVALID)
+      p += plyTypeSize(before.type);
+    else
+      p += plyTypeSize(before.count_type) + (size_t)plyRead(p, before.count_type, swap) * plyTypeSize(before.type);
+  }
+  return p;
+}
+
+static const PlyProperty *plyFind(const PlyElement &element, const char *const names[])
+{
+  for (int i = 0; names[i]; i++)
+    for (const PlyProperty &prop : element.properties)
+      if (prop.name == names[i] && prop.count_type == PLY_INVALID)
+        return &prop;
+  return NULL;
+}
+
+static bool importPly(const MappedFile &file, ImportedMesh *mesh, ThreadPool *pool)
+{
+  TRACE_SCOPE("importPly");
+
+  const char *data = file.data;
+  const char *end = data + file.size;
+
+  // Header: text lines up to "end_header"
+  std::vector<PlyElement> elements;
+  bool swap = false, format_ok = false;
+  const char *body = NULL;
+  for (const char *line = data; line < end && !body; line = nextLine(line, end))
+  {
+    std::string text(line, nextLine(line, end) - line);
+    while (!text.empty() && (text.back() == '\n' || text.back() == '\r'))
+      text.pop_back();
+
+    char a[64], b[64], c[64], d[64];
+    if (text == "end_header")
+      body = nextLine(line, end);
+    else if (sscanf(text.c_str(), "format %63s", a) == 1)
+    {
+      format_ok = strcmp(a, "binary_little_endian") == 0 || strcmp(a, "binary_big_endian") == 0;
+      swap = strcmp(a, "binary_big_endian") == 0;
+      const uint16_t one = 1;
+      if (*(const char *)&one == 0)
+        swap = !swap; // big endian host
+    }
+    else if (sscanf(text.c_str(), "element %63s %63s", a, b) == 2)
+    {
+      PlyElement element;
+      element.name = a;
+      element.count = strtoull(b, NULL, 10);
+      element.record_size = 0;
+      elements.push_back(element);
+    }
+    else if (sscanf(text.c_str(), "property list %63s %63s %63s", a, b, c) == 3 && !elements.empty())
+      elements.back().properties.push_back({c, plyType(b), plyType(a), 0});
+    else if (sscanf(text.c_str(), "property %63s %63s", a, d) == 2 && !elements.empty())
+      elements.back().properties.push_back({d, plyType(a), PLY_INVALID, 0});
+  }
+
+  if (!body || !format_ok)
+  {
+    fprintf(stderr, "ERROR: only binary PLY files are supported\n");
+    return false;
+  }
+
+  for (PlyElement &element : elements)
+  {
+    size_t offset = 0;
+    bool fixed = true;
+    for (PlyProperty &prop : element.properties)
+    {
+      if (prop.type == PLY_INVALID)
+      {
+        fprintf(stderr, "ERROR: unknown PLY type in property %s\n", prop.name.c_str());
+        return false;
+      }
+      prop.offset = offset;
+      offset += plyTypeSize(prop.type);
+      fixed = fixed && prop.count_type == PLY_INVALID;
+    }
+    element.record_size = fixed ? offset : 0;
+  }
+
+  // Where each element's data starts
+  const unsigned char *p = (const unsigned char *)body;
+  const unsigned char *uend = (const unsigned char *)end;
+  const PlyElement *vertex = NULL, *face = NULL;
+  const unsigned char *vertex_data = NULL, *face_data = NULL;
+  for (const PlyElement &element : elements)
+  {
+    if (element.name == "vertex")
+      vertex = &element, vertex_data = p;
+    else if (element.name == "face")
+      face = &element, face_data = p;
+
+    if (element.record_size)
+    {
+      if ((size_t)(uend - p) / element.record_size < element.count)
+        p = NULL;
+      else
+        p += element.record_size * element.count;
+    }
+    else if (&element != face) // faces are scanned below
+      for (size_t i = 0; i < element.count && p; i++)
+        p = plySkipRecord(element, p, uend, swap);
+
+    if (p == NULL)
+    {
+      fprintf(stderr, "ERROR: PLY file truncated in element %s\n", element.name.c_str());
+      return false;
+    }
+    if (&element == face)
+      break; // anything after the faces is not needed
+  }
+
+  static const char *const x_names[] = {"x", NULL}, *const y_names[] = {"y", NULL}, *const z_names[] = {"z", NULL};
+  static const char *const u_names[] = {"u", "s", "texture_u", "texture_s", NULL};
+  static const char *const v_names[] = {"v", "t", "texture_v", "texture_t", NULL};
+  const PlyProperty *px = vertex ? plyFind(*vertex, x_names) : NULL;
+  const PlyProperty *py = vertex ? plyFind(*vertex, y_names) : NULL;
+  const PlyProperty *pz = vertex ? plyFind(*vertex, z_names) : NULL;
+  const PlyProperty *pu = vertex ? plyFind(*vertex, u_names) : NULL;
+  const PlyProperty *pv = vertex ? plyFind(*vertex, v_names) : NULL;
+
+  const PlyProperty *indices = NULL;
+  if (face)
+    for (const PlyProperty &prop : face->properties)
+      if (prop.count_type != PLY_INVALID && (prop.name == "vertex_indices" || prop.name == "vertex_index"))
+        indices = &prop;
+
+  if (!px || !py || !pz || !vertex->record_size || !indices)
+  {
+    fprintf(stderr, "ERROR: PLY needs fixed size vertices with x, y, z and faces with vertex_indices\n");
+    return false;
+  }
+
+  // Vertices, in parallel ranges
+  size_t v_count = vertex->count;
+  std::vector<GLfloat> positions(v_count * 3), uvs(v_count * 2, 0.0f);
+  parallelFor(pool, v_count, 65536, [&](int begin, int end) {
+    for (int i = begin; i < end; i++)
+    {
+      const unsigned char *record = vertex_data + (size_t)i * vertex->record_size;
+      positions[i * 3] = plyRead(record + px->offset, px->type, swap);
+      positions[i * 3 + 1] = plyRead(record + py->offset, py->type, swap);
+      positions[i * 3 + 2] = plyRead(record + pz->offset, pz->type, swap);
+      if (pu && pv)
+      {
+        uvs[i * 2] = plyRead(record + pu->offset, pu->type, swap);
+        uvs[i * 2 + 1] = plyRead(record + pv->offset, pv->type, swap);
+      }
+    }
+  });
+
+  // Faces: find block starts and triangle counts, then fan them in parallel
+  size_t blocks = (face->count + PLY_FACE_BLOCK - 1) / PLY_FACE_BLOCK;
+  std::vector<const unsigned char *> block_start(blocks);
+  std::vector<size_t> block_corner(blocks + 1, 0);
+  p = face_data;
+  for (size_t f = 0; f < face->count; f++)
+  {
+    if (f % PLY_FACE_BLOCK == 0)
+      block_start[f / PLY_FACE_BLOCK] = p;
+
+    const unsigned char *next = plySkipRecord(*face, p, uend, swap);
+    if (next == NULL)
+    {
+      fprintf(stderr, "ERROR: PLY file truncated in element face\n");
+      return false;
+    }
+
+    size_t n = (size_t)plyRead(plyListStart(*face, indices, p, swap), indices->count_type, swap);
+    if (n >= 3)
+      block_corner[f / PLY_FACE_BLOCK + 1] += (n - 2) * 3;
+    p = next;
+  }
+  for (size_t b = 0; b < blocks; b++)
+    block_corner[b + 1] += block_corner[b];
+
+  size_t corner_count = block_corner[blocks];
+  mesh->positions.resize(corner_count * 3);
+  mesh->uvs.resize(corner_count * 2);
+  std::vector<char> bad(blocks, 0);
+  parallelFor(pool, blocks, 1, [&](int begin, int end) {
+    for (int b = begin; b < end; b++)
+    {
+      const unsigned char *record = block_start[b];
+      size_t k = block_corner[b];
+      size_t last = (size_t)(b + 1) * PLY_FACE_BLOCK < face->count ? (size_t)(b + 1) * PLY_FACE_BLOCK : face->count;
+      for (size_t f = (size_t)b * PLY_FACE_BLOCK; f < last && !bad[b]; f++)
+      {
+        const unsigned char *list = plyListStart(*face, indices, record, swap);
+        size_t n = (size_t)plyRead(list, indices->count_type, swap);
+        const unsigned char *idx = list + plyTypeSize(indices->count_type);
+        size_t index_size = plyTypeSize(indices->type);
+        for (size_t t = 1; t + 1 < n; t++)
+        {
+          size_t fan[3] = {0, t, t + 1};
+          for (int j = 0; j < 3; j++, k++)
+          {
+            double i = plyRead(idx + fan[j] * index_size, indices->type, swap);
+            if (i < 0 || i >= v_count)
+            {
+              bad[b] = 1;
+              break;
+            }
+            memcpy(&mesh->positions[k * 3], &positions[(size_t)i * 3], sizeof(GLfloat) * 3);
+            memcpy(&mesh->uvs[k * 2], &uvs[(size_t)i * 2], sizeof(GLfloat) * 2);
+          }
+        }
+        record = plySkipRecord(*face, record, uend, swap);
+      }
+    }
+  });
+
+  for (size_t b = 0; b < blocks; b++)
+    if (bad[b])
+    {
+      fprintf(stderr, "ERROR: PLY face index out of range (%zu vertices)\n", v_count);
+      return false;
+    }
+
+  return true;
+}
+
+// -------------------------------------------------------------------------
+
+bool importMesh(const char *path, ImportedMesh *mesh, ThreadPool *pool)
+{
+  const char *ext = strrchr(path, '.');
+  bool obj = ext && strcasecmp(ext, ".obj") == 0;
+  bool ply = ext && strcasecmp(ext, ".ply") == 0;
+  if (!obj && !ply)
+  {
+    fprintf(stderr, "ERROR: %s: unknown mesh format (.obj or .ply expected)\n", path);
+    return false;
+  }
+
+  MappedFile file;
+  if (!mapFile(path, &file))
+    return false;
+
+  bool ok = obj ? importObj(file, mesh, pool) : importPly(file, mesh, pool);
+  unmapFile(&file);
+
+  if (ok)
+    printf("Imported %s: %zu triangles\n", path, mesh->positions.size() / 9);
+  return ok;
+}
+
+MeshSource importedMeshSource(const ImportedMesh &mesh, const MeshSource &options)
+{
+  MeshSource source = options;
+  source.positions = mesh.positions.data();
+  source.uvs = mesh.uvs.data();
+  source.size = mesh.positions.size();
+  return source;
+}
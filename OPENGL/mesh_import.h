@@ -0,0 +1,38 @@
+// mesh_import.h: Wavefront OBJ and binary PLY loading
+//
+// The file is memory-mapped and parsed in chunks on the thread pool. The
+// result is a triangle list ready for buildMesh(): polygons are fanned
+// into triangles and every corner gets its position and uv copied.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef MESH_IMPORT_H
+#define MESH_IMPORT_H
+
+#include <GL/glew.h>
+
+#include <vector>
+
+#include "mesh.h"
+#include "thread_pool.h"
+
+struct ImportedMesh
+{
+  std::vector<GLfloat> positions; // 9 floats per triangle
+  std::vector<GLfloat> uvs;       // 6 floats per triangle, 0 if the file has none
+};
+
+// Format from the extension (.obj or .ply). Prints the reason and returns
+// false if the file cannot be read or parsed. pool may be NULL.
+bool importMesh(const char *path, ImportedMesh *mesh, ThreadPool *pool);
+
+// Source for buildMesh() pointing into mesh, with the build options of
+// options
+MeshSource importedMeshSource(const ImportedMesh &mesh, const MeshSource &options);
+
+// Decimal float parser for the importers: returns the end of the number,
+// or s if there is none. Plain double arithmetic when that is exact (up to
+// 2^53 in the digits, exponent within +-22: nearly every mesh file),
+// strtod() otherwise.
+const char *parseFloat(const char *s, const char *end, float *value);
+
+#endif
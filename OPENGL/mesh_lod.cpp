@@ -0,0 +1,289 @@
+// mesh_lod.cpp
+//
+// Garland-Heckbert quadrics with half-edge collapses, done in passes: each
+// pass picks the cheapest collapse of every vertex, sorts them and applies
+// those whose neighbourhoods do not overlap (so costs and adjacency stay
+// valid within the pass), then drops the degenerate triangles. Quadrics
+// accumulate over the whole chain, each level starting from the previous.
+//////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "mesh_lod.h"
+
+// Levels stop when they remove less than this fraction of the triangles
+#define LOD_MIN_REDUCTION 0.1f
+
+// Collapses further than this (relative to the mesh radius) are refused
+#define LOD_MAX_ERROR 0.05f
+
+// Symmetric 4x4 matrix: xx xy xz xw yy yz yw zz zw ww
+struct Quadric
+{
+  double q[10];
+};
+
+static void addPlane(Quadric &quadric, const double n[3], double d)
+{
+  const double p[4] = {n[0], n[1], n[2], d};
+  int k = 0;
+  for (int i = 0; i < 4; i++)
+    for (int j = i; j < 4; j++)
+      quadric.q[k++] += p[i] * p[j];
+}
+
+static void addQuadric(Quadric &a, const Quadric &b)
+{
+  for (int k = 0; k < 10; k++)
+    a.q[k] += b.q[k];
+}
+
+// Sum of squared distances from p to the planes of the quadric
+static double evaluate(const Quadric &a, const Quadric &b, const glm::vec3 &p)
+{
+  double q[10];
+  for (int k = 0; k < 10; k++)
+    q[k] = a.q[k] + b.q[k];
+  double x = p.x, y = p.y, z = p.z;
+  return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x + q[4] * y * y + 2 * q[5] * y * z +
+         2 * q[6] * y + q[7] * z * z + 2 * q[8] * z + q[9];
+}
+
+static glm::vec3 triangleNormal(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c)
+{
+  return glm::cross(b - a, c - a);
+}
+
+// Vertices that must not move: position shared with another vertex, or
+// on an edge with a single triangle
+static void findLocked(const Vertex vertices[], int vertex_count, const GLuint indices[], int index_count,
+                       char locked[], ScratchArena *scratch)
+{
+  // Position ids: sort by position, equal runs share the id
+  uint32_t *order = arenaAllocArray<uint32_t>(scratch, vertex_count);
+  uint32_t *position_id = arenaAllocArray<uint32_t>(scratch, vertex_count);
+  for (int v = 0; v < vertex_count; v++)
+    order[v] = v;
+  auto less = [&](uint32_t a, uint32_t b) {
+    const glm::vec3 &p = vertices[a].position, &q = vertices[b].position;
+    return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+  };
+  std::sort(order, order + vertex_count, less);
+
+  std::fill(locked, locked + vertex_count, 0);
+  uint32_t id = 0;
+  for (int i = 0; i < vertex_count; i++)
+  {
+    if (i > 0 && less(order[i - 1], order[i]))
+      id++;
+    position_id[order[i]] = id;
+    if ((i > 0 && !less(order[i - 1], order[i])) || (i + 1 < vertex_count && !less(order[i], order[i + 1])))
+      locked[order[i]] = 1;
+  }
+
+  // Directed edges by position; a border edge has no reverse twin
+  uint64_t *edges = arenaAllocArray<uint64_t>(scratch, index_count);
+  for (int t = 0; t < index_count; t += 3)
+    for (int j = 0; j < 3; j++)
+      edges[t + j] = ((uint64_t)position_id[indices[t + j]] << 32) | position_id[indices[t + (j + 1) % 3]];
+  std::sort(edges, edges + index_count);
+
+  for (int t = 0; t < index_count; t += 3)
+    for (int j = 0; j < 3; j++)
+    {
+      GLuint a = indices[t + j], b = indices[t + (j + 1) % 3];
+      uint64_t twin = ((uint64_t)position_id[b] << 32) | position_id[a];
+      if (!std::binary_search(edges, edges + index_count, twin))
+        locked[a] = locked[b] = 1;
+    }
+}
+
+struct Collapse
+{
+  double cost;
+  GLuint from, to;
+};
+
+// One pass over indices (in place). Returns the new index count; *error
+// grows to the largest collapse distance.
+static int simplifyPass(const Vertex vertices[], int vertex_count, GLuint indices[], int index_count, int target,
+                        Quadric quadrics[], const char locked[], double max_cost, double *error, ScratchArena *scratch)
+{
+  // Triangles of each vertex
+  int *offset = arenaAllocArray<int>(scratch, vertex_count + 1);
+  memset(offset, 0, sizeof(int) * (vertex_count + 1));
+  for (int i = 0; i < index_count; i++)
+    offset[indices[i] + 1]++;
+  for (int v = 0; v < vertex_count; v++)
+    offset[v + 1] += offset[v];
+  int *fill = arenaAllocArray<int>(scratch, vertex_count);
+  memcpy(fill, offset, sizeof(int) * vertex_count);
+  int *adjacency = arenaAllocArray<int>(scratch, index_count);
+  for (int i = 0; i < index_count; i++)
+    adjacency[fill[indices[i]]++] = i / 3;
+
+  // Cheapest edge of every movable vertex
+  std::vector<Collapse> collapses;
+  for (int v = 0; v < vertex_count; v++)
+  {
+    if (locked[v] || offset[v] == offset[v + 1])
+      continue;
+
+    Collapse best = {max_cost, 0, 0};
+    bool found = false;
+    for (int a = offset[v]; a < offset[v + 1]; a++)
+    {
+      const GLuint *tri = indices + adjacency[a] * 3;
+      for (int j = 0; j < 3; j++)
+      {
+        GLuint to = tri[j];
+        if (to == (GLuint)v)
+          continue;
+        double cost = evaluate(quadrics[v], quadrics[to], vertices[to].position);
+        if (cost <= best.cost)
+        {
+          best = {cost, (GLuint)v, to};
+          found = true;
+        }
+      }
+    }
+    if (found)
+      collapses.push_back(best);
+  }
+  std::sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) { return a.cost < b.cost; });
+
+  char *touched = arenaAllocArray<char>(scratch, vertex_count);
+  memset(touched, 0, vertex_count);
+  GLuint *remap = arenaAllocArray<GLuint>(scratch, vertex_count);
+  for (int v = 0; v < vertex_count; v++)
+    remap[v] = v;
+
+  // An interior collapse removes 2 triangles
+  int triangles = index_count / 3;
+  for (const Collapse &c : collapses)
+  {
+    if (triangles <= target / 3)
+      break;
+    if (touched[c.from] || touched[c.to])
+      continue;
+
+    // Refuse collapses that flip a remaining triangle
+    bool flips = false;
+    const glm::vec3 &moved = vertices[c.to].position;
+    for (int a = offset[c.from]; a < offset[c.from + 1] && !flips; a++)
+    {
+      const GLuint *tri = indices + adjacency[a] * 3;
+      if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+        continue;
+      glm::vec3 p[3], q[3];
+      for (int j = 0; j < 3; j++)
+      {
+        p[j] = vertices[tri[j]].position;
+        q[j] = tri[j] == c.from ? moved : p[j];
+      }
+      glm::vec3 before = triangleNormal(p[0], p[1], p[2]), after = triangleNormal(q[0], q[1], q[2]);
+      flips = glm::dot(before, after) <= 0.0f;
+    }
+    if (flips)
+      continue;
+
+    remap[c.from] = c.to;
+    addQuadric(quadrics[c.to], quadrics[c.from]);
+    *error = std::max(*error, sqrt(std::max(c.cost, 0.0)));
+    for (int a = offset[c.from]; a < offset[c.from + 1]; a++)
+    {
+      const GLuint *tri = indices + adjacency[a] * 3;
+      touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+      triangles -= tri[0] == c.to || tri[1] == c.to || tri[2] == c.to;
+    }
+  }
+
+  // Apply and drop the triangles that became degenerate
+  int out = 0;
+  for (int t = 0; t < index_count; t += 3)
+  {
+    GLuint a = remap[indices[t]], b = remap[indices[t + 1]], c = remap[indices[t + 2]];
+    if (a == b || b == c || a == c)
+      continue;
+    indices[out++] = a;
+    indices[out++] = b;
+    indices[out++] = c;
+  }
+  return out;
+}
+
+int buildLods(const Vertex vertices[], int vertex_count, std::vector<GLuint> &indices, MeshLod lods[], int max_levels,
+              ScratchArena *scratch)
+{
+  int index_count = indices.size();
+  lods[0].first_index = 0;
+  lods[0].index_count = index_count;
+  lods[0].error = 0.0f;
+  if (max_levels <= 1 || vertex_count <= 0 || index_count < 3 * 64)
+    return 1;
+
+  char *locked = arenaAllocArray<char>(scratch, vertex_count);
+  findLocked(vertices, vertex_count, indices.data(), index_count, locked, scratch);
+
+  // Plane quadrics of every triangle, unweighted: errors are distances
+  Quadric *quadrics = arenaAllocArray<Quadric>(scratch, vertex_count);
+  memset(quadrics, 0, sizeof(Quadric) * vertex_count);
+  for (int t = 0; t < index_count; t += 3)
+  {
+    const glm::vec3 &a = vertices[indices[t]].position;
+    glm::vec3 n = triangleNormal(a, vertices[indices[t + 1]].position, vertices[indices[t + 2]].position);
+    float length = glm::length(n);
+    if (length == 0.0f)
+      continue;
+    double plane[3] = {n.x / length, n.y / length, n.z / length};
+    double d = -(plane[0] * a.x + plane[1] * a.y + plane[2] * a.z);
+    for (int j = 0; j < 3; j++)
+      addPlane(quadrics[indices[t + j]], plane, d);
+  }
+
+  glm::vec3 low = vertices[0].position, high = low;
+  for (int v = 1; v < vertex_count; v++)
+  {
+    low = glm::min(low, vertices[v].position);
+    high = glm::max(high, vertices[v].position);
+  }
+  double max_error = LOD_MAX_ERROR * 0.5 * glm::length(high - low);
+
+  // Every level works on a copy of the previous one at the end of indices
+  int levels = 1;
+  double error = 0.0;
+  ArenaMark mark = arenaMark(scratch);
+  while (levels < max_levels)
+  {
+    const MeshLod &previous = lods[levels - 1];
+    std::vector<GLuint> level(indices.begin() + previous.first_index,
+                              indices.begin() + previous.first_index + previous.index_count);
+    int count = level.size();
+    int target = (count / 2) / 3 * 3;
+
+    while (count > target)
+    {
+      arenaRewind(scratch, mark);
+      int reduced = simplifyPass(vertices, vertex_count, level.data(), count, target, quadrics, locked,
+                                 max_error * max_error, &error, scratch);
+      if (reduced == count)
+        break;
+      count = reduced;
+    }
+
+    if (count > previous.index_count * (1.0f - LOD_MIN_REDUCTION))
+      break;
+
+    lods[levels].first_index = indices.size();
+    lods[levels].index_count = count;
+    lods[levels].error = error;
+    indices.insert(indices.end(), level.begin(), level.begin() + count);
+    levels++;
+  }
+
+  return levels;
+}
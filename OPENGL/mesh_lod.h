@@ -0,0 +1,28 @@
+// mesh_lod.h: levels of detail by quadric edge collapse
+//
+// Every level is an index buffer over the same vertices: collapses move a
+// vertex onto a neighbour instead of creating new ones, so one VBO serves
+// the whole chain and the levels just follow each other in the EBO.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include <vector>
+
+#include "arena.h"
+#include "mesh.h"
+
+// Appends up to max_levels - 1 coarser levels to indices, each about half
+// the triangles of the one before, and describes all of them (level 0 =
+// the original indices) in lods. Stops early when a level cannot get
+// noticeably smaller. Returns the number of levels.
+//
+// Vertices that share their position with another one (normal or uv
+// seams) and vertices on open borders never move, which keeps seams and
+// silhouettes of open meshes intact. Flat shaded meshes are all seams, so
+// they only get level 0.
+int buildLods(const Vertex vertices[], int vertex_count, std::vector<GLuint> &indices, MeshLod lods[], int max_levels,
+              ScratchArena *scratch);
+
+#endif
@@ -0,0 +1,237 @@
+// mesh_optimize.cpp
+//
+// Tipsify walks the mesh fanning around one vertex at a time. The next
+// fan centre is a vertex of the last fans that will still be in the cache
+// (best: the oldest one that is), else the most recent vertex with triangles
+// left (dead-end stack), else the next such vertex in index order. The last
+// two cases start a new cluster for the overdraw pass.
+//////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "mesh_optimize.h"
+
+VertexCacheStats analyzeVertexCache(const GLuint indices[], int index_count, int vertex_count)
+{
+  VertexCacheStats stats = {0.0f, 0.0f};
+  if (index_count < 3)
+    return stats;
+
+  // FIFO: a vertex is cached if it entered less than VERTEX_CACHE_SIZE misses ago
+  std::vector<int> entered(vertex_count, -VERTEX_CACHE_SIZE - 1);
+  std::vector<char> used(vertex_count, 0);
+  int misses = 0, referenced = 0;
+  for (int i = 0; i < index_count; i++)
+  {
+    GLuint v = indices[i];
+    if (misses - entered[v] > VERTEX_CACHE_SIZE)
+    {
+      entered[v] = misses;
+      misses++;
+    }
+    referenced += !used[v];
+    used[v] = 1;
+  }
+
+  stats.acmr = (float)misses / (index_count / 3);
+  stats.atvr = referenced ? (float)misses / referenced : 0.0f;
+  return stats;
+}
+
+// Next fan centre, or -1 when every triangle has been emitted
+static int skipDeadEnd(std::vector<GLuint> &dead_end, const int live[], int vertex_count, int *cursor)
+{
+  while (!dead_end.empty())
+  {
+    GLuint d = dead_end.back();
+    dead_end.pop_back();
+    if (live[d] > 0)
+      return d;
+  }
+  for (; *cursor < vertex_count; (*cursor)++)
+    if (live[*cursor] > 0)
+      return *cursor;
+  return -1;
+}
+
+// Tipsify proper. Writes the new triangle order to order[] and the start
+// of each cluster (in triangles) to clusters.
+static void tipsify(const GLuint indices[], int triangle_count, int vertex_count, int order[],
+                    std::vector<int> &clusters, ScratchArena *scratch)
+{
+  int index_count = triangle_count * 3;
+
+  // Triangles of each vertex: adjacency[offset[v] .. offset[v + 1])
+  int *offset = arenaAllocArray<int>(scratch, vertex_count + 1);
+  int *live = arenaAllocArray<int>(scratch, vertex_count);
+  memset(live, 0, sizeof(int) * vertex_count);
+  for (int i = 0; i < index_count; i++)
+    live[indices[i]]++;
+  offset[0] = 0;
+  for (int v = 0; v < vertex_count; v++)
+    offset[v + 1] = offset[v] + live[v];
+
+  int *fill = arenaAllocArray<int>(scratch, vertex_count);
+  memcpy(fill, offset, sizeof(int) * vertex_count);
+  int *adjacency = arenaAllocArray<int>(scratch, index_count);
+  for (int i = 0; i < index_count; i++)
+    adjacency[fill[indices[i]]++] = i / 3;
+
+  int *cache_time = arenaAllocArray<int>(scratch, vertex_count);
+  memset(cache_time, 0, sizeof(int) * vertex_count);
+  char *emitted = arenaAllocArray<char>(scratch, triangle_count);
+  memset(emitted, 0, triangle_count);
+
+  std::vector<GLuint> dead_end, candidates;
+  int time = VERTEX_CACHE_SIZE + 1;
+  int cursor = 0;
+  int emitted_count = 0;
+
+  int fan = skipDeadEnd(dead_end, live, vertex_count, &cursor);
+  clusters.push_back(0);
+  while (fan >= 0)
+  {
+    candidates.clear();
+    for (int a = offset[fan]; a < offset[fan + 1]; a++)
+    {
+      int t = adjacency[a];
+      if (emitted[t])
+        continue;
+
+      for (int j = 0; j < 3; j++)
+      {
+        GLuint v = indices[t * 3 + j];
+        dead_end.push_back(v);
+        candidates.push_back(v);
+        live[v]--;
+        if (time - cache_time[v] > VERTEX_CACHE_SIZE)
+          cache_time[v] = time++;
+      }
+      emitted[t] = 1;
+      order[emitted_count++] = t;
+    }
+
+    // Best candidate: still has triangles and will still be cached after
+    // its fan (2 new vertices per triangle at most); oldest first
+    int next = -1, best = -1;
+    for (GLuint v : candidates)
+    {
+      if (live[v] <= 0)
+        continue;
+      int priority = 0;
+      if (time - cache_time[v] + 2 * live[v] <= VERTEX_CACHE_SIZE)
+        priority = time - cache_time[v];
+      if (priority > best)
+      {
+        best = priority;
+        next = v;
+      }
+    }
+
+    if (next < 0)
+    {
+      next = skipDeadEnd(dead_end, live, vertex_count, &cursor);
+      if (next >= 0 && emitted_count < triangle_count)
+        clusters.push_back(emitted_count);
+    }
+    fan = next;
+  }
+}
+
+// Sorts the clusters by how much they face away from the mesh centre
+static void sortClusters(const GLuint indices[], const Vertex vertices[], int order[], int triangle_count,
+                         const std::vector<int> &clusters, ScratchArena *scratch)
+{
+  int cluster_count = clusters.size();
+
+  // Area weighted centroids and normals (cross product = 2 * area * normal)
+  std::vector<glm::vec3> centroid(cluster_count, glm::vec3(0.0f)), normal(cluster_count, glm::vec3(0.0f));
+  std::vector<float> area(cluster_count, 0.0f);
+  glm::vec3 mesh_centroid(0.0f);
+  float mesh_area = 0.0f;
+  for (int c = 0; c < cluster_count; c++)
+  {
+    int end = c + 1 < cluster_count ? clusters[c + 1] : triangle_count;
+    for (int k = clusters[c]; k < end; k++)
+    {
+      const GLuint *tri = indices + order[k] * 3;
+      glm::vec3 a = vertices[tri[0]].position, b = vertices[tri[1]].position, d = vertices[tri[2]].position;
+      glm::vec3 cross = glm::cross(b - a, d - a);
+      float weight = glm::length(cross);
+      centroid[c] += (a + b + d) * (weight / 3.0f);
+      normal[c] += cross;
+      area[c] += weight;
+    }
+    mesh_centroid += centroid[c];
+    mesh_area += area[c];
+    if (area[c] > 0.0f)
+      centroid[c] /= area[c];
+  }
+  if (mesh_area > 0.0f)
+    mesh_centroid /= mesh_area;
+
+  std::vector<float> facing(cluster_count);
+  std::vector<int> sorted(cluster_count);
+  for (int c = 0; c < cluster_count; c++)
+  {
+    float length = glm::length(normal[c]);
+    facing[c] = length > 0.0f ? glm::dot(centroid[c] - mesh_centroid, normal[c] / length) : 0.0f;
+    sorted[c] = c;
+  }
+  std::stable_sort(sorted.begin(), sorted.end(), [&](int a, int b) { return facing[a] > facing[b]; });
+
+  int *reordered = arenaAllocArray<int>(scratch, triangle_count);
+  int k = 0;
+  for (int c : sorted)
+  {
+    int end = c + 1 < cluster_count ? clusters[c + 1] : triangle_count;
+    for (int t = clusters[c]; t < end; t++)
+      reordered[k++] = order[t];
+  }
+  memcpy(order, reordered, sizeof(int) * triangle_count);
+}
+
+void optimizeVertexCache(GLuint indices[], int index_count, int vertex_count, const Vertex vertices[], bool overdraw,
+                         ScratchArena *scratch)
+{
+  int triangle_count = index_count / 3;
+  if (triangle_count < 2)
+    return;
+
+  int *order = arenaAllocArray<int>(scratch, triangle_count);
+  std::vector<int> clusters;
+  tipsify(indices, triangle_count, vertex_count, order, clusters, scratch);
+
+  if (overdraw)
+    sortClusters(indices, vertices, order, triangle_count, clusters, scratch);
+
+  GLuint *reordered = arenaAllocArray<GLuint>(scratch, index_count);
+  for (int k = 0; k < triangle_count; k++)
+    memcpy(reordered + k * 3, indices + order[k] * 3, sizeof(GLuint) * 3);
+  memcpy(indices, reordered, sizeof(GLuint) * index_count);
+}
+
+int optimizeVertexFetch(Vertex vertices[], int vertex_count, GLuint indices[], int index_count, ScratchArena *scratch)
+{
+  GLuint *remap = arenaAllocArray<GLuint>(scratch, vertex_count);
+  memset(remap, 0xff, sizeof(GLuint) * vertex_count);
+  Vertex *reordered = arenaAllocArray<Vertex>(scratch, vertex_count);
+
+  int used = 0;
+  for (int i = 0; i < index_count; i++)
+  {
+    GLuint v = indices[i];
+    if (remap[v] == 0xffffffffu)
+    {
+      remap[v] = used;
+      reordered[used++] = vertices[v];
+    }
+    indices[i] = remap[v];
+  }
+
+  memcpy(vertices, reordered, sizeof(Vertex) * used);
+  return used;
+}
@@ -0,0 +1,33 @@
+// mesh_optimize.h: triangle and vertex order of indexed meshes
+//
+// - Triangle order for the post-transform vertex cache: Tipsify (Sander,
+//   Nehab, Barczak, "Fast Triangle Reordering for Vertex Locality and
+//   Reduced Overdraw", 2007), linear time.
+// - Optionally, Tipsify's clusters sorted outside-in to reduce overdraw.
+// - Vertex order by first use, for locality of the vertex fetch.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+
+#include "arena.h"
+#include "mesh.h"
+
+// Cache size the reordering targets and the statistics simulate (FIFO)
+#define VERTEX_CACHE_SIZE 16
+
+// VertexCacheStats (in mesh.h) of an index buffer
+VertexCacheStats analyzeVertexCache(const GLuint indices[], int index_count, int vertex_count);
+
+// Reorders the triangles of indices in place. With overdraw the clusters
+// Tipsify finds are then sorted so that the ones facing away from the mesh
+// centre (that tend to hide the others) are drawn first; needs vertices
+// for the positions.
+void optimizeVertexCache(GLuint indices[], int index_count, int vertex_count, const Vertex vertices[], bool overdraw,
+                         ScratchArena *scratch);
+
+// Renumbers vertices in order of first use by indices (which is updated)
+// and drops unreferenced ones. Returns the new vertex count.
+int optimizeVertexFetch(Vertex vertices[], int vertex_count, GLuint indices[], int index_count, ScratchArena *scratch);
+
+#endif
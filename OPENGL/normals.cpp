@@ -0,0 +1,311 @@
+// normals.cpp
+//
+// Smooth normals: a hash of the vertex positions gives each corner a
+// position id, a counting sort lists the corners of each position, and
+// every corner then sums the face normals of that list.
+//
+// Face normal kernels. The SIMD ones load a batch of triangles, transpose
+// them to SoA (one register per coordinate of each vertex), do the cross
+// products lane-wise and transpose back to write each normal three times.
+//////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "normals.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define NORMALS_X86 1
+#include <immintrin.h>
+#endif
+
+typedef void (*FaceNormalsFn)(GLfloat *normals, const GLfloat polygon[], int first, int last, bool normalize);
+
+static void faceNormalsScalar(GLfloat *normals, const GLfloat polygon[], int first, int last, bool normalize)
+{
+  for (int t = first; t < last; t++)
+  {
+    const GLfloat *v = polygon + t * 9;
+    GLfloat *n = normals + t * 9;
+
+    GLfloat U[] = {v[3] - v[0], v[4] - v[1], v[5] - v[2]};
+    GLfloat V[] = {v[6] - v[0], v[7] - v[1], v[8] - v[2]};
+
+    GLfloat x = U[1] * V[2] - U[2] * V[1];
+    GLfloat y = U[2] * V[0] - U[0] * V[2];
+    GLfloat z = U[0] * V[1] - U[1] * V[0];
+
+    if (normalize)
+    {
+      GLfloat length = sqrtf(x * x + y * y + z * z);
+      if (length > 0.0f)
+      {
+        x /= length;
+        y /= length;
+        z /= length;
+      }
+    }
+
+    n[0] = n[3] = n[6] = x;
+    n[1] = n[4] = n[7] = y;
+    n[2] = n[5] = n[8] = z;
+  }
+}
+
+#ifdef NORMALS_X86
+
+// Writes the normal (x, y, z, junk) of a triangle to its 3 vertices. Each
+// 4-wide store spills one float into the next vertex, which the following
+// store (or the next triangle) overwrites.
+#define STORE_NORMAL3(dst, row)       \
+  do                                  \
+  {                                   \
+    _mm_storeu_ps((dst), (row));      \
+    _mm_storeu_ps((dst) + 3, (row));  \
+    _mm_storeu_ps((dst) + 6, (row));  \
+  } while (0)
+
+// 4 triangles per iteration. Stops one triangle short of the end so the
+// spilled float always lands inside the array; the scalar code finishes.
+static void faceNormalsSse(GLfloat *normals, const GLfloat polygon[], int first, int last, bool normalize)
+{
+  int t = first;
+  for (; t + 4 < last; t += 4)
+  {
+    const GLfloat *q = polygon + t * 9;
+
+    // a[j] = coordinate j (0..8) of the 4 triangles
+    __m128 a[9];
+    for (int j = 0; j < 9; j++)
+      a[j] = _mm_setr_ps(q[j], q[9 + j], q[18 + j], q[27 + j]);
+
+    __m128 ux = _mm_sub_ps(a[3], a[0]), uy = _mm_sub_ps(a[4], a[1]), uz = _mm_sub_ps(a[5], a[2]);
+    __m128 vx = _mm_sub_ps(a[6], a[0]), vy = _mm_sub_ps(a[7], a[1]), vz = _mm_sub_ps(a[8], a[2]);
+
+    __m128 x = _mm_sub_ps(_mm_mul_ps(uy, vz), _mm_mul_ps(uz, vy));
+    __m128 y = _mm_sub_ps(_mm_mul_ps(uz, vx), _mm_mul_ps(ux, vz));
+    __m128 z = _mm_sub_ps(_mm_mul_ps(ux, vy), _mm_mul_ps(uy, vx));
+
+    if (normalize)
+    {
+      __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)));
+      // 0 / FLT_MIN keeps degenerate triangles at 0
+      length = _mm_max_ps(length, _mm_set1_ps(1.17549435e-38f));
+      x = _mm_div_ps(x, length);
+      y = _mm_div_ps(y, length);
+      z = _mm_div_ps(z, length);
+    }
+
+    // Back to one (x, y, z, 0) row per triangle
+    __m128 w = _mm_setzero_ps();
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+
+    GLfloat *n = normals + t * 9;
+    STORE_NORMAL3(n, x);
+    STORE_NORMAL3(n + 9, y);
+    STORE_NORMAL3(n + 18, z);
+    STORE_NORMAL3(n + 27, w);
+  }
+
+  faceNormalsScalar(normals, polygon, t, last, normalize);
+}
+
+// Same as the SSE kernel with 8 triangles per iteration and gathers
+// instead of per-lane loads
+__attribute__((target("avx2"))) static void faceNormalsAvx2(GLfloat *normals, const GLfloat polygon[], int first, int last, bool normalize)
+{
+  const __m256i stride = _mm256_setr_epi32(0, 9, 18, 27, 36, 45, 54, 63);
+
+  int t = first;
+  for (; t + 8 < last; t += 8)
+  {
+    const GLfloat *q = polygon + t * 9;
+
+    __m256 a[9];
+    for (int j = 0; j < 9; j++)
+      a[j] = _mm256_i32gather_ps(q + j, stride, 4);
+
+    __m256 ux = _mm256_sub_ps(a[3], a[0]), uy = _mm256_sub_ps(a[4], a[1]), uz = _mm256_sub_ps(a[5], a[2]);
+    __m256 vx = _mm256_sub_ps(a[6], a[0]), vy = _mm256_sub_ps(a[7], a[1]), vz = _mm256_sub_ps(a[8], a[2]);
+
+    __m256 x = _mm256_sub_ps(_mm256_mul_ps(uy, vz), _mm256_mul_ps(uz, vy));
+    __m256 y = _mm256_sub_ps(_mm256_mul_ps(uz, vx), _mm256_mul_ps(ux, vz));
+    __m256 z = _mm256_sub_ps(_mm256_mul_ps(ux, vy), _mm256_mul_ps(uy, vx));
+
+    if (normalize)
+    {
+      __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, x), _mm256_mul_ps(y, y)), _mm256_mul_ps(z, z)));
+      length = _mm256_max_ps(length, _mm256_set1_ps(1.17549435e-38f));
+      x = _mm256_div_ps(x, length);
+      y = _mm256_div_ps(y, length);
+      z = _mm256_div_ps(z, length);
+    }
+
+    GLfloat *n = normals + t * 9;
+    for (int half = 0; half < 2; half++)
+    {
+      __m128 hx = half ? _mm256_extractf128_ps(x, 1) : _mm256_castps256_ps128(x);
+      __m128 hy = half ? _mm256_extractf128_ps(y, 1) : _mm256_castps256_ps128(y);
+      __m128 hz = half ? _mm256_extractf128_ps(z, 1) : _mm256_castps256_ps128(z);
+      __m128 hw = _mm_setzero_ps();
+      _MM_TRANSPOSE4_PS(hx, hy, hz, hw);
+
+      GLfloat *h = n + half * 36;
+      STORE_NORMAL3(h, hx);
+      STORE_NORMAL3(h + 9, hy);
+      STORE_NORMAL3(h + 18, hz);
+      STORE_NORMAL3(h + 27, hw);
+    }
+  }
+
+  faceNormalsScalar(normals, polygon, t, last, normalize);
+}
+
+#endif
+
+struct FaceNormalsKernel
+{
+  FaceNormalsFn fn;
+  const char *name;
+};
+
+static FaceNormalsKernel selectKernel()
+{
+  FaceNormalsKernel k = {faceNormalsScalar, "scalar"};
+#ifdef NORMALS_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    k = {faceNormalsAvx2, "avx2"};
+  else if (__builtin_cpu_supports("sse2"))
+    k = {faceNormalsSse, "sse"};
+#endif
+  return k;
+}
+
+// Chosen on first use (thread-safe static initialization)
+static const FaceNormalsKernel &activeKernel()
+{
+  static const FaceNormalsKernel kernel = selectKernel();
+  return kernel;
+}
+
+void computeFaceNormals(GLfloat *normals, const GLfloat polygon[], int triangles, bool normalize)
+{
+  activeKernel().fn(normals, polygon, 0, triangles, normalize);
+}
+
+// FNV-1a over the 3 floats of a position, -0 already turned into +0
+static uint32_t hashPosition(const GLfloat p[3])
+{
+  uint32_t words[3];
+  memcpy(words, p, sizeof(words));
+  uint64_t h = 14695981039346656037ull;
+  for (int i = 0; i < 3; i++)
+  {
+    h ^= words[i];
+    h *= 1099511628211ull;
+  }
+  return (uint32_t)(h ^ (h >> 32));
+}
+
+// Gives each of the count positions the id of the first equal one, in
+// 0..unique-1. Returns the number of unique positions.
+static int positionIds(const GLfloat polygon[], int count, uint32_t ids[], ScratchArena *scratch)
+{
+  // Open addressing, at most half full. Slots hold first vertex + 1 (0 = empty).
+  uint32_t table_size = 16;
+  while (table_size < (uint32_t)count * 2)
+    table_size *= 2;
+  uint32_t *table = arenaAllocArray<uint32_t>(scratch, table_size);
+  memset(table, 0, sizeof(uint32_t) * table_size);
+
+  GLfloat *keys = arenaAllocArray<GLfloat>(scratch, count * 3);
+  int unique = 0;
+  for (int i = 0; i < count; i++)
+  {
+    GLfloat *key = keys + i * 3;
+    for (int j = 0; j < 3; j++)
+      key[j] = polygon[i * 3 + j] + 0.0f;
+
+    uint32_t slot = hashPosition(key) & (table_size - 1);
+    while (table[slot] != 0 && memcmp(keys + (table[slot] - 1) * 3, key, sizeof(GLfloat) * 3) != 0)
+      slot = (slot + 1) & (table_size - 1);
+
+    if (table[slot] == 0)
+    {
+      table[slot] = i + 1;
+      ids[i] = unique++;
+    }
+    else
+      ids[i] = ids[table[slot] - 1];
+  }
+
+  return unique;
+}
+
+void computeSmoothNormals(GLfloat *normals, const GLfloat polygon[], int triangles, float crease_degrees,
+                          ScratchArena *scratch)
+{
+  int count = triangles * 3;
+
+  // Un-normalized face normals (length = twice the area, which is the
+  // weight) written to the 3 corners; unit[] keeps them normalized for the
+  // crease test
+  computeFaceNormals(normals, polygon, triangles, false);
+  GLfloat *face = arenaAllocArray<GLfloat>(scratch, triangles * 3);
+  GLfloat *unit = arenaAllocArray<GLfloat>(scratch, triangles * 3);
+  for (int t = 0; t < triangles; t++)
+  {
+    memcpy(face + t * 3, normals + t * 9, sizeof(GLfloat) * 3);
+    GLfloat *u = unit + t * 3;
+    GLfloat length = sqrtf(face[t * 3] * face[t * 3] + face[t * 3 + 1] * face[t * 3 + 1] + face[t * 3 + 2] * face[t * 3 + 2]);
+    for (int j = 0; j < 3; j++)
+      u[j] = length > 0.0f ? face[t * 3 + j] / length : 0.0f;
+  }
+
+  // Corners of each position: corners[start[p] .. start[p + 1])
+  uint32_t *ids = arenaAllocArray<uint32_t>(scratch, count);
+  int positions = positionIds(polygon, count, ids, scratch);
+
+  uint32_t *start = arenaAllocArray<uint32_t>(scratch, positions + 1);
+  memset(start, 0, sizeof(uint32_t) * (positions + 1));
+  for (int i = 0; i < count; i++)
+    start[ids[i] + 1]++;
+  for (int p = 0; p < positions; p++)
+    start[p + 1] += start[p];
+
+  uint32_t *fill = arenaAllocArray<uint32_t>(scratch, positions);
+  memcpy(fill, start, sizeof(uint32_t) * positions);
+  uint32_t *corners = arenaAllocArray<uint32_t>(scratch, count);
+  for (int i = 0; i < count; i++)
+    corners[fill[ids[i]]++] = i;
+
+  GLfloat min_cos = cosf(crease_degrees * 3.14159265f / 180.0f);
+  for (int i = 0; i < count; i++)
+  {
+    const GLfloat *own = unit + (i / 3) * 3;
+    bool degenerate = own[0] == 0.0f && own[1] == 0.0f && own[2] == 0.0f;
+
+    // Same order for every corner of the position, so corners that end up
+    // in the same smoothing group get bit-identical sums (and weld)
+    GLfloat sum[3] = {0.0f, 0.0f, 0.0f};
+    for (uint32_t k = start[ids[i]]; k < start[ids[i] + 1]; k++)
+    {
+      int t = corners[k] / 3;
+      const GLfloat *u = unit + t * 3;
+      if (degenerate || own[0] * u[0] + own[1] * u[1] + own[2] * u[2] >= min_cos)
+        for (int j = 0; j < 3; j++)
+          sum[j] += face[t * 3 + j];
+    }
+
+    GLfloat length = sqrtf(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+    for (int j = 0; j < 3; j++)
+      normals[i * 3 + j] = length > 0.0f ? sum[j] / length : 0.0f;
+  }
+}
+
+const char *faceNormalsKernel()
+{
+  return activeKernel().name;
+}
@@ -0,0 +1,34 @@
+// normals.h: flat (per face) and smooth (per vertex) normals of triangle
+// lists
+//
+// Face normals are done by a scalar, an SSE (4 triangles at a time) or an
+// AVX2 (8 triangles at a time) kernel, picked once at runtime from the CPU
+// features.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef NORMALS_H
+#define NORMALS_H
+
+#include <GL/glew.h>
+
+#include "arena.h"
+
+// polygon holds 9 floats per triangle (3 vertices x, y, z). The cross
+// product of each triangle is written to its 3 vertices in normals, which
+// has the same size as polygon. With normalize the result has length 1
+// (degenerate triangles stay 0).
+void computeFaceNormals(GLfloat *normals, const GLfloat polygon[], int triangles, bool normalize);
+
+// Same layout as computeFaceNormals(), but each vertex gets the area
+// weighted sum of the normals of the triangles around its position (same
+// x, y, z bits) that are within crease_degrees of its own triangle. Where
+// the angle between faces is bigger the vertex keeps a different normal on
+// each side, so welding splits it there. Results have length 1.
+// Temporaries come from scratch. Linear time for bounded vertex valence.
+void computeSmoothNormals(GLfloat *normals, const GLfloat polygon[], int triangles, float crease_degrees,
+                          ScratchArena *scratch);
+
+// "scalar", "sse" or "avx2"
+const char *faceNormalsKernel();
+
+#endif
@@ -0,0 +1,8 @@
+#version 330 core
+
+out vec4 frag_col;
+
+// Color writes are off, only the samples passed count
+void main() {
+    frag_col = vec4(1.0);
+}
@@ -0,0 +1,17 @@
+#version 330 core
+
+in vec3 corner; // 0 or 1 per axis
+
+// Same block as the lighting shaders (uniform_blocks.h)
+layout(std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    vec3 view_pos;
+};
+
+uniform vec3 box_min;
+uniform vec3 box_size;
+
+void main() {
+    gl_Position = projection * view * vec4(box_min + corner * box_size, 1.0);
+}
@@ -0,0 +1,220 @@
+// occlusion_queries.cpp
+//////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "gl_state.h"
+#include "occlusion_queries.h"
+#include "textfile_ALT.h"
+#include "uniform_blocks.h"
+
+#define ATTRIB_CORNER 0
+
+// Boxes are grown by this fraction of their size (plus a small constant),
+// so the faces of the object itself never hide its own box
+#define BOX_MARGIN 0.01f
+
+static GLuint compileShader(GLenum type, const char *path)
+{
+  char *source = textFileRead(path);
+  if (source == NULL)
+  {
+    printf("ERROR: could not read %s\n", path);
+    return 0;
+  }
+
+  GLuint shader = glCreateShader(type);
+  glShaderSource(shader, 1, &source, NULL);
+  free(source);
+  glCompileShader(shader);
+
+  int success;
+  char infoLog[512];
+  glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+  if (!success)
+  {
+    glGetShaderInfoLog(shader, 512, NULL, infoLog);
+    printf("ERROR: %s compilation failed!\n%s\n", path, infoLog);
+    glDeleteShader(shader);
+    return 0;
+  }
+  return shader;
+}
+
+bool occlusionCreate(OcclusionQueries *oq, const char *vs_path, const char *fs_path)
+{
+  oq->target = GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility ? GL_ANY_SAMPLES_PASSED_CONSERVATIVE
+                                                              : GL_ANY_SAMPLES_PASSED;
+  oq->current = 0;
+  oq->tested = oq->culled = 0;
+  for (OcclusionFrame &frame : oq->ring)
+  {
+    frame.issued = 0;
+    frame.pending = false;
+  }
+
+  GLuint vs = compileShader(GL_VERTEX_SHADER, vs_path);
+  GLuint fs = compileShader(GL_FRAGMENT_SHADER, fs_path);
+  if (!vs || !fs)
+  {
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    return false;
+  }
+
+  oq->program = glCreateProgram();
+  glAttachShader(oq->program, vs);
+  glAttachShader(oq->program, fs);
+  glBindAttribLocation(oq->program, ATTRIB_CORNER, "corner");
+  glLinkProgram(oq->program);
+  glDeleteShader(vs);
+  glDeleteShader(fs);
+
+  int success;
+  char infoLog[512];
+  glGetProgramiv(oq->program, GL_LINK_STATUS, &success);
+  if (!success)
+  {
+    glGetProgramInfoLog(oq->program, 512, NULL, infoLog);
+    printf("ERROR: Occlusion box program linking failed!\n%s\n", infoLog);
+    glDeleteProgram(oq->program);
+    return false;
+  }
+  bindUniformBlocks(oq->program);
+  oq->box_min_location = glGetUniformLocation(oq->program, "box_min");
+  oq->box_size_location = glGetUniformLocation(oq->program, "box_size");
+
+  // Unit cube, 12 triangles
+  static const GLfloat corners[] = {0, 0, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 0, 0, 1, 1, 0, 1, 1, 1, 1, 0, 1, 1};
+  static const GLubyte indices[] = {0, 2, 1, 0, 3, 2, 4, 5, 6, 4, 6, 7, 0, 1, 5, 0, 5, 4,
+                                    3, 6, 2, 3, 7, 6, 0, 4, 7, 0, 7, 3, 1, 2, 6, 1, 6, 5};
+  glGenVertexArrays(1, &oq->vao);
+  glGenBuffers(1, &oq->vbo);
+  glGenBuffers(1, &oq->ebo);
+  stateBindVertexArray(oq->vao);
+  glBindBuffer(GL_ARRAY_BUFFER, oq->vbo);
+  glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+  glVertexAttribPointer(ATTRIB_CORNER, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+  glEnableVertexAttribArray(ATTRIB_CORNER);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, oq->ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+  stateBindVertexArray(0);
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+  return true;
+}
+
+void occlusionDestroy(OcclusionQueries *oq)
+{
+  for (OcclusionFrame &frame : oq->ring)
+  {
+    if (!frame.queries.empty())
+      glDeleteQueries(frame.queries.size(), frame.queries.data());
+    frame.queries.clear();
+  }
+  glDeleteVertexArrays(1, &oq->vao);
+  glDeleteBuffers(1, &oq->vbo);
+  glDeleteBuffers(1, &oq->ebo);
+  glDeleteProgram(oq->program);
+  stateInvalidate();
+}
+
+// Reads a query set back. Unless wait, only if the GPU is done with it.
+static void resolveFrame(OcclusionQueries *oq, OcclusionFrame &frame, bool wait)
+{
+  if (!frame.pending)
+    return;
+
+  // Queries complete in order, so the last one issued tells about all of them
+  if (!wait && frame.issued > 0)
+  {
+    GLint available = 0;
+    glGetQueryObjectiv(frame.queries[frame.issued - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      return;
+  }
+
+  for (int q = 0; q < frame.issued; q++)
+  {
+    GLuint passed = 0;
+    glGetQueryObjectuiv(frame.queries[q], GL_QUERY_RESULT, &passed);
+    oq->occluded[frame.objects[q]] = passed == 0;
+  }
+  frame.pending = false;
+}
+
+void occlusionResolve(OcclusionQueries *oq)
+{
+  // Oldest set first, so newer results win
+  for (int i = 1; i <= OCCLUSION_FRAMES; i++)
+    resolveFrame(oq, oq->ring[(oq->current + i) % OCCLUSION_FRAMES], false);
+}
+
+void occlusionFilter(OcclusionQueries *oq, std::vector<int> *objects)
+{
+  size_t kept = 0;
+  for (int object : *objects)
+    if (object >= (int)oq->occluded.size() || !oq->occluded[object])
+      (*objects)[kept++] = object;
+  oq->culled += objects->size() - kept;
+  objects->resize(kept);
+}
+
+void occlusionIssue(OcclusionQueries *oq, const std::vector<int> &objects, const Aabb bounds[],
+                    const glm::vec3 &camera_pos)
+{
+  OcclusionFrame &frame = oq->ring[oq->current];
+  oq->current = (oq->current + 1) % OCCLUSION_FRAMES;
+
+  // The GPU is OCCLUSION_FRAMES behind: only then this waits
+  resolveFrame(oq, frame, true);
+
+  if (frame.queries.size() < objects.size())
+  {
+    size_t old_size = frame.queries.size();
+    frame.queries.resize(objects.size());
+    glGenQueries(objects.size() - old_size, frame.queries.data() + old_size);
+  }
+  frame.objects.clear();
+  frame.issued = 0;
+
+  stateUseProgram(oq->program);
+  stateBindVertexArray(oq->vao);
+  glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+  glDepthMask(GL_FALSE);
+  glDepthFunc(GL_LEQUAL);
+
+  for (int object : objects)
+  {
+    if (object >= (int)oq->occluded.size())
+      oq->occluded.resize(object + 1, 0);
+
+    const Aabb &box = bounds[object];
+    glm::vec3 margin = BOX_MARGIN * (box.max - box.min) + glm::vec3(1e-3f);
+    glm::vec3 box_min = box.min - margin, box_max = box.max + margin;
+    bool around_camera = true;
+    for (int c = 0; c < 3; c++)
+      around_camera = around_camera && camera_pos[c] >= box_min[c] && camera_pos[c] <= box_max[c];
+    if (around_camera)
+    {
+      oq->occluded[object] = 0;
+      continue;
+    }
+
+    stateUniform3f(oq->box_min_location, box_min);
+    stateUniform3f(oq->box_size_location, box_max - box_min);
+    glBeginQuery(oq->target, frame.queries[frame.issued]);
+    glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_BYTE, NULL);
+    glEndQuery(oq->target);
+    frame.objects.push_back(object);
+    frame.issued++;
+  }
+
+  glDepthFunc(GL_LESS);
+  glDepthMask(GL_TRUE);
+  glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+  frame.pending = frame.issued > 0;
+  oq->tested += frame.issued;
+}
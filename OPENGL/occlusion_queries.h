@@ -0,0 +1,70 @@
+// occlusion_queries.h: hardware occlusion culling with query readback
+//
+// After the frame's draws, the bounding box of every candidate object is
+// drawn (no color or depth writes) inside an any-samples-passed query
+// against the depth buffer just filled. The results are read back frames
+// later, when the GPU says they are available, and objects whose box
+// passed no samples are left out of the next draw lists until a query
+// says otherwise. Reading late never stalls the pipeline; the price is
+// that an object coming into view appears a frame or two late.
+//
+// Queries are GL_ANY_SAMPLES_PASSED_CONSERVATIVE where supported (GL 4.3 /
+// ARB_ES3_compatibility), GL_ANY_SAMPLES_PASSED otherwise.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef OCCLUSION_QUERIES_H
+#define OCCLUSION_QUERIES_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "culling.h"
+
+// Frames of queries in flight before a set is reused
+#define OCCLUSION_FRAMES 3
+
+struct OcclusionFrame
+{
+  std::vector<GLuint> queries;
+  std::vector<int> objects; // object tested by each query
+  int issued;
+  bool pending;
+};
+
+struct OcclusionQueries
+{
+  GLenum target;
+  GLuint program;
+  GLint box_min_location, box_size_location;
+  GLuint vao, vbo, ebo;
+
+  OcclusionFrame ring[OCCLUSION_FRAMES];
+  int current;
+  std::vector<uint8_t> occluded; // per object, latest result read back
+
+  uint64_t tested; // queries issued, all frames
+  uint64_t culled; // objects left out, all frames
+};
+
+// Builds the box program from its shader files (the Camera uniform block
+// gives the view). Needs the GL context; false if the shaders fail.
+bool occlusionCreate(OcclusionQueries *oq, const char *vs_path, const char *fs_path);
+void occlusionDestroy(OcclusionQueries *oq);
+
+// Reads back every query set the GPU is done with. Never waits.
+void occlusionResolve(OcclusionQueries *oq);
+
+// Removes the objects known to be occluded from objects, counting them
+void occlusionFilter(OcclusionQueries *oq, std::vector<int> *objects);
+
+// Issues a query for the box of each object (bounds[object]). Call after
+// the frame's draws. Boxes around the camera are taken as visible without
+// a query, the near plane would clip them.
+void occlusionIssue(OcclusionQueries *oq, const std::vector<int> &objects, const Aabb bounds[],
+                    const glm::vec3 &camera_pos);
+
+#endif
@@ -0,0 +1,41 @@
+// radix_sort.cpp
+//////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include "radix_sort.h"
+
+void radixSort(SortPacket packets[], SortPacket scratch[], int count)
+{
+  uint32_t histograms[8][256];
+  memset(histograms, 0, sizeof(histograms));
+  for (int i = 0; i < count; i++)
+    for (int d = 0; d < 8; d++)
+      histograms[d][(packets[i].key >> (8 * d)) & 0xff]++;
+
+  SortPacket *from = packets, *to = scratch;
+  for (int d = 0; d < 8; d++)
+  {
+    uint32_t *histogram = histograms[d];
+    if (count == 0 || histogram[(from[0].key >> (8 * d)) & 0xff] == (uint32_t)count)
+      continue;
+
+    // Counts to first positions
+    uint32_t offset = 0;
+    for (int b = 0; b < 256; b++)
+    {
+      uint32_t n = histogram[b];
+      histogram[b] = offset;
+      offset += n;
+    }
+    for (int i = 0; i < count; i++)
+      to[histogram[(from[i].key >> (8 * d)) & 0xff]++] = from[i];
+
+    SortPacket *swap = from;
+    from = to;
+    to = swap;
+  }
+
+  if (from != packets)
+    memcpy(packets, from, sizeof(SortPacket) * count);
+}
@@ -0,0 +1,25 @@
+// radix_sort.h: LSD radix sort of 64-bit keys
+//
+// 8 passes of 8 bits, least significant first, each a stable counting
+// sort into the other buffer. One pass over the input builds the 8
+// histograms up front; a digit that is the same for every key leaves the
+// order unchanged and its pass is skipped, so keys with few distinct high
+// bits cost only the passes that matter. Linear in count, and stable.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <stdint.h>
+
+struct SortPacket
+{
+  uint64_t key;
+  uint32_t index; // whatever the key sorts, e.g. a position in an array
+};
+
+// Sorts packets by key. scratch holds count packets; the result ends up
+// in packets.
+void radixSort(SortPacket packets[], SortPacket scratch[], int count);
+
+#endif
@@ -0,0 +1,51 @@
+// scene_graph.cpp
+//////////////////////////////////////////////////////////////////////
+
+#include <assert.h>
+
+#include <algorithm>
+
+#include "scene_graph.h"
+
+int sceneAddNode(SceneGraph *scene, int parent, const glm::mat4 &local)
+{
+  int node = scene->parent.size();
+  assert(parent < node);
+  scene->parent.push_back(parent);
+  scene->local.push_back(local);
+  scene->world.push_back(glm::mat4(1.0f));
+  scene->normal.push_back(glm::mat3(1.0f));
+  scene->dirty.push_back(1);
+  scene->first_dirty = std::min(scene->first_dirty, node);
+  return node;
+}
+
+void sceneSetLocal(SceneGraph *scene, int node, const glm::mat4 &local)
+{
+  if (scene->local[node] == local)
+    return;
+  scene->local[node] = local;
+  scene->dirty[node] = 1;
+  scene->first_dirty = std::min(scene->first_dirty, node);
+}
+
+void sceneUpdate(SceneGraph *scene)
+{
+  int count = scene->parent.size();
+  for (int i = scene->first_dirty; i < count; i++)
+  {
+    // Parents come first: their flag already says whether they moved
+    int parent = scene->parent[i];
+    if (!scene->dirty[i] && (parent < 0 || !scene->dirty[parent]))
+      continue;
+
+    scene->world[i] = parent < 0 ? scene->local[i] : scene->world[parent] * scene->local[i];
+    scene->normal[i] = glm::transpose(glm::inverse(glm::mat3(scene->world[i])));
+    scene->dirty[i] = 1;
+    scene->updates++;
+  }
+
+  if (scene->first_dirty < count)
+    std::fill(scene->dirty.begin() + scene->first_dirty, scene->dirty.end(), 0);
+  scene->first_dirty = count;
+}
@@ -0,0 +1,40 @@
+// scene_graph.h: transform hierarchy in flat arrays
+//
+// Nodes are indices into parallel arrays. A node is added after its
+// parent, so the arrays are already in topological order and one linear
+// pass computes every world matrix from its parent's, which is always
+// done by then. Only nodes whose local matrix changed, and their
+// descendants, are recomputed; the pass starts at the first dirty node, so
+// a frame where nothing moved costs nothing.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+
+#include <stdint.h>
+
+#include <vector>
+
+struct SceneGraph
+{
+  std::vector<int> parent; // -1 for roots, else a smaller index
+  std::vector<glm::mat4> local;
+  std::vector<glm::mat4> world;
+  std::vector<glm::mat3> normal;  // inverse transpose of world's 3x3
+  std::vector<uint8_t> dirty;     // world is stale
+  int first_dirty;                // no dirty node before it
+  uint64_t updates;               // world matrices computed, all time
+};
+
+// Returns the new node. parent is -1 or an existing node.
+int sceneAddNode(SceneGraph *scene, int parent, const glm::mat4 &local);
+
+// Marks the node dirty if local differs from its current one
+void sceneSetLocal(SceneGraph *scene, int node, const glm::mat4 &local);
+
+// Brings world and normal up to date
+void sceneUpdate(SceneGraph *scene);
+
+#endif
@@ -0,0 +1,267 @@
+// software_occlusion.cpp
+//
+// Triangles are set up once as 3 edge functions and a depth plane, all
+// linear in the pixel position, then evaluated per row 4 pixels at a
+// time. Pixels outside the triangle get depth 0, so a plain max() against
+// the buffer is the depth test and the write at once.
+//
+// Occluders must not hide more than they do on the real screen, where a
+// pixel of this buffer is several pixels wide: the edge functions and the
+// depth plane are moved by half a pixel, so a pixel is only written if
+// the triangle covers it whole, and with the triangle's farthest depth
+// over it.
+//////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+
+#include <algorithm>
+
+#include "software_occlusion.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SOFT_OCCLUSION_X86 1
+#include <immintrin.h>
+#endif
+
+// Occluder triangles with a vertex nearer than this (in w) are skipped
+// rather than clipped, losing a little occlusion
+#define OCCLUDER_NEAR 0.1f
+
+#define TILES_X (SOFT_OCCLUSION_WIDTH / SOFT_OCCLUSION_TILE)
+#define TILES_Y (SOFT_OCCLUSION_HEIGHT / SOFT_OCCLUSION_TILE)
+
+void occluderMeshFrom(OccluderMesh *occluder, const Vertex vertices[], int vertex_count, const GLuint indices[],
+                      int lod_count, const MeshLod lods[])
+{
+  int level = lod_count - 1;
+  while (level > 0 && lods[level - 1].index_count / 3 <= SOFT_OCCLUDER_TRIANGLES)
+    level--;
+
+  occluder->positions.resize(vertex_count);
+  for (int v = 0; v < vertex_count; v++)
+    occluder->positions[v] = vertices[v].position;
+  occluder->indices.assign(indices + lods[level].first_index,
+                           indices + lods[level].first_index + lods[level].index_count);
+}
+
+// Pixel coordinates and 1/w of a clip space position
+static glm::vec3 toScreen(const glm::vec4 &clip)
+{
+  float inv_w = 1.0f / clip.w;
+  return glm::vec3((clip.x * inv_w * 0.5f + 0.5f) * SOFT_OCCLUSION_WIDTH,
+                   (clip.y * inv_w * 0.5f + 0.5f) * SOFT_OCCLUSION_HEIGHT, inv_w);
+}
+
+static void transformOccluders(SoftOcclusion *so, const glm::mat4 &view_projection,
+                               const OccluderMesh *const meshes[], const glm::mat4 models[], int count)
+{
+  std::vector<glm::vec4> clip;
+  so->triangles.clear();
+  for (int o = 0; o < count; o++)
+  {
+    const OccluderMesh &mesh = *meshes[o];
+    glm::mat4 mvp = view_projection * models[o];
+    clip.resize(mesh.positions.size());
+    for (size_t v = 0; v < mesh.positions.size(); v++)
+      clip[v] = mvp * glm::vec4(mesh.positions[v], 1.0f);
+
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+    {
+      const glm::vec4 &a = clip[mesh.indices[i]], &b = clip[mesh.indices[i + 1]], &c = clip[mesh.indices[i + 2]];
+      if (a.w < OCCLUDER_NEAR || b.w < OCCLUDER_NEAR || c.w < OCCLUDER_NEAR)
+        continue;
+      glm::vec3 s[3] = {toScreen(a), toScreen(b), toScreen(c)};
+      for (const glm::vec3 &p : s)
+        so->triangles.insert(so->triangles.end(), {p.x, p.y, p.z});
+    }
+  }
+}
+
+// a x + b y + c
+struct Plane2
+{
+  float a, b, c;
+};
+
+// Rasterizes every triangle into rows [y0, y1)
+static void rasterizeBand(SoftOcclusion *so, int y0, int y1)
+{
+  const float *t = so->triangles.data();
+  size_t count = so->triangles.size() / 9;
+  for (size_t i = 0; i < count; i++, t += 9)
+  {
+    glm::vec3 v[3] = {glm::vec3(t[0], t[1], t[2]), glm::vec3(t[3], t[4], t[5]), glm::vec3(t[6], t[7], t[8])};
+
+    float min_y = std::min(v[0].y, std::min(v[1].y, v[2].y));
+    float max_y = std::max(v[0].y, std::max(v[1].y, v[2].y));
+    int row0 = std::max(y0, (int)floorf(min_y));
+    int row1 = std::min(y1 - 1, (int)floorf(max_y));
+    if (row0 > row1)
+      continue;
+    float min_x = std::min(v[0].x, std::min(v[1].x, v[2].x));
+    float max_x = std::max(v[0].x, std::max(v[1].x, v[2].x));
+    int col0 = std::max(0, (int)floorf(min_x)) & ~3;
+    int col1 = std::min(SOFT_OCCLUSION_WIDTH - 1, (int)floorf(max_x));
+    if (col0 > col1)
+      continue;
+
+    // Counter-clockwise on screen, whichever way the mesh winds
+    float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+    if (fabsf(area) < 1e-6f)
+      continue;
+    if (area < 0.0f)
+    {
+      std::swap(v[1], v[2]);
+      area = -area;
+    }
+
+    // Edge i is opposite vertex i: positive inside, and divided by the
+    // area it is the barycentric weight of vertex i
+    Plane2 edge[3];
+    for (int e = 0; e < 3; e++)
+    {
+      const glm::vec3 &p = v[(e + 1) % 3], &q = v[(e + 2) % 3];
+      edge[e].a = p.y - q.y;
+      edge[e].b = q.x - p.x;
+      edge[e].c = p.x * q.y - p.y * q.x;
+    }
+    Plane2 z = {0.0f, 0.0f, 0.0f};
+    for (int e = 0; e < 3; e++)
+    {
+      z.a += edge[e].a * v[e].z / area;
+      z.b += edge[e].b * v[e].z / area;
+      z.c += edge[e].c * v[e].z / area;
+    }
+
+    // Half a pixel inwards and farther: evaluated at a pixel's center,
+    // they give its worst corner
+    for (int e = 0; e < 3; e++)
+      edge[e].c -= 0.5f * (fabsf(edge[e].a) + fabsf(edge[e].b));
+    z.c -= 0.5f * (fabsf(z.a) + fabsf(z.b));
+
+    for (int y = row0; y <= row1; y++)
+    {
+      float py = y + 0.5f;
+      float *row = so->depth.data() + y * SOFT_OCCLUSION_WIDTH;
+#ifdef SOFT_OCCLUSION_X86
+      __m128 step = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+      __m128 ea[3], er[3];
+      for (int e = 0; e < 3; e++)
+      {
+        ea[e] = _mm_set1_ps(edge[e].a);
+        er[e] = _mm_set1_ps(edge[e].b * py + edge[e].c);
+      }
+      __m128 za = _mm_set1_ps(z.a), zr = _mm_set1_ps(z.b * py + z.c);
+      for (int x = col0; x <= col1; x += 4)
+      {
+        __m128 px = _mm_add_ps(_mm_set1_ps((float)x), step);
+        __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(ea[0], px), er[0]), _mm_setzero_ps());
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(ea[1], px), er[1]), _mm_setzero_ps()));
+        inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(ea[2], px), er[2]), _mm_setzero_ps()));
+        __m128 depth = _mm_and_ps(inside, _mm_add_ps(_mm_mul_ps(za, px), zr));
+        _mm_storeu_ps(row + x, _mm_max_ps(_mm_loadu_ps(row + x), depth));
+      }
+#else
+      for (int x = col0; x <= col1; x++)
+      {
+        float px = x + 0.5f;
+        bool inside = true;
+        for (int e = 0; e < 3; e++)
+          inside = inside && edge[e].a * px + edge[e].b * py + edge[e].c >= 0.0f;
+        if (inside)
+          row[x] = std::max(row[x], z.a * px + z.b * py + z.c);
+      }
+#endif
+    }
+  }
+
+  for (int ty = y0 / SOFT_OCCLUSION_TILE; ty < y1 / SOFT_OCCLUSION_TILE; ty++)
+    for (int tx = 0; tx < TILES_X; tx++)
+    {
+      float farthest = INFINITY;
+      for (int y = 0; y < SOFT_OCCLUSION_TILE; y++)
+      {
+        const float *row = so->depth.data() + (ty * SOFT_OCCLUSION_TILE + y) * SOFT_OCCLUSION_WIDTH;
+        for (int x = 0; x < SOFT_OCCLUSION_TILE; x++)
+          farthest = std::min(farthest, row[tx * SOFT_OCCLUSION_TILE + x]);
+      }
+      so->tile_min[ty * TILES_X + tx] = farthest;
+    }
+}
+
+void softOcclusionRender(SoftOcclusion *so, const glm::mat4 &view_projection, const OccluderMesh *const meshes[],
+                         const glm::mat4 models[], int count, ThreadPool *pool)
+{
+  so->depth.assign(SOFT_OCCLUSION_WIDTH * SOFT_OCCLUSION_HEIGHT, 0.0f);
+  so->tile_min.assign(TILES_X * TILES_Y, 0.0f);
+  transformOccluders(so, view_projection, meshes, models, count);
+  so->occluders += count;
+
+  // One band per tile row: bands never share pixels or tiles
+  parallelFor(pool, TILES_Y, 1, [so](int begin, int end) {
+    for (int band = begin; band < end; band++)
+      rasterizeBand(so, band * SOFT_OCCLUSION_TILE, (band + 1) * SOFT_OCCLUSION_TILE);
+  });
+}
+
+// Whether some pixel of [x0, x1] x [y0, y1] has no occluder nearer than depth
+static bool anyPixelBehind(const SoftOcclusion *so, int x0, int y0, int x1, int y1, float depth)
+{
+  for (int ty = y0 / SOFT_OCCLUSION_TILE; ty <= y1 / SOFT_OCCLUSION_TILE; ty++)
+    for (int tx = x0 / SOFT_OCCLUSION_TILE; tx <= x1 / SOFT_OCCLUSION_TILE; tx++)
+    {
+      // The whole tile is in front
+      if (so->tile_min[ty * TILES_X + tx] > depth)
+        continue;
+
+      int row0 = std::max(y0, ty * SOFT_OCCLUSION_TILE), row1 = std::min(y1, ty * SOFT_OCCLUSION_TILE + 7);
+      int col0 = std::max(x0, tx * SOFT_OCCLUSION_TILE), col1 = std::min(x1, tx * SOFT_OCCLUSION_TILE + 7);
+      for (int y = row0; y <= row1; y++)
+      {
+        const float *row = so->depth.data() + y * SOFT_OCCLUSION_WIDTH;
+        for (int x = col0; x <= col1; x++)
+          if (row[x] <= depth)
+            return true;
+      }
+    }
+  return false;
+}
+
+static bool boxHidden(const SoftOcclusion *so, const glm::mat4 &view_projection, const Aabb &box)
+{
+  float lo_x = INFINITY, lo_y = INFINITY, hi_x = -INFINITY, hi_y = -INFINITY;
+  float nearest = 0.0f;
+  for (int c = 0; c < 8; c++)
+  {
+    glm::vec3 corner(c & 1 ? box.max.x : box.min.x, c & 2 ? box.max.y : box.min.y, c & 4 ? box.max.z : box.min.z);
+    glm::vec4 clip = view_projection * glm::vec4(corner, 1.0f);
+    // Crossing the camera plane: its projection is unbounded
+    if (clip.w < OCCLUDER_NEAR)
+      return false;
+    glm::vec3 s = toScreen(clip);
+    lo_x = std::min(lo_x, s.x);
+    lo_y = std::min(lo_y, s.y);
+    hi_x = std::max(hi_x, s.x);
+    hi_y = std::max(hi_y, s.y);
+    nearest = std::max(nearest, s.z);
+  }
+
+  int x0 = std::max(0, (int)floorf(lo_x)), x1 = std::min(SOFT_OCCLUSION_WIDTH - 1, (int)floorf(hi_x));
+  int y0 = std::max(0, (int)floorf(lo_y)), y1 = std::min(SOFT_OCCLUSION_HEIGHT - 1, (int)floorf(hi_y));
+  // Off screen: for the frustum test to decide
+  if (x0 > x1 || y0 > y1)
+    return false;
+  return !anyPixelBehind(so, x0, y0, x1, y1, nearest);
+}
+
+void softOcclusionFilter(SoftOcclusion *so, const glm::mat4 &view_projection, const Aabb bounds[],
+                         std::vector<int> *objects)
+{
+  size_t kept = 0;
+  for (int object : *objects)
+    if (!boxHidden(so, view_projection, bounds[object]))
+      (*objects)[kept++] = object;
+  so->tested += objects->size();
+  so->culled += objects->size() - kept;
+  objects->resize(kept);
+}
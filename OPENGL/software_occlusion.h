@@ -0,0 +1,69 @@
+// software_occlusion.h: CPU depth-only rasterizer for occlusion culling
+//
+// A few large occluders are rasterized into a small depth buffer holding
+// 1/w per pixel (linear in screen space, bigger is nearer), the nearest
+// occluder winning. The buffer is split in bands of tile rows, rasterized
+// in parallel on the worker pool, 4 pixels at a time with SSE. Each 8x8
+// tile also keeps its farthest depth, so testing a box can settle whole
+// tiles at once and only look at pixels where the tile is not conclusive.
+//
+// A box is hidden when every pixel its projection touches holds an
+// occluder nearer than the box's nearest corner. Occluders only fill the
+// pixels they cover whole, so the low resolution never hides more than
+// the real screen would; what can is the occluders' level of detail,
+// which may stick out of the mesh by its simplification error. No GPU
+// round trip is involved: results are for this very frame.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef SOFTWARE_OCCLUSION_H
+#define SOFTWARE_OCCLUSION_H
+
+#include <glm/glm.hpp>
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "culling.h"
+#include "mesh.h"
+#include "thread_pool.h"
+
+// Multiples of SOFT_OCCLUSION_TILE
+#define SOFT_OCCLUSION_WIDTH 256
+#define SOFT_OCCLUSION_HEIGHT 160
+#define SOFT_OCCLUSION_TILE 8
+// Finest level of detail an occluder is rasterized with
+#define SOFT_OCCLUDER_TRIANGLES 2048
+
+struct OccluderMesh
+{
+  std::vector<glm::vec3> positions;
+  std::vector<GLuint> indices;
+};
+
+// Keeps the finest level of the mesh within SOFT_OCCLUDER_TRIANGLES
+// (the coarsest one if none is)
+void occluderMeshFrom(OccluderMesh *occluder, const Vertex vertices[], int vertex_count, const GLuint indices[],
+                      int lod_count, const MeshLod lods[]);
+
+struct SoftOcclusion
+{
+  std::vector<float> depth;     // 1/w, 0 where no occluder is
+  std::vector<float> tile_min;  // farthest depth of each tile
+  std::vector<float> triangles; // screen x, y, 1/w of 3 vertices each
+
+  uint64_t occluders; // rasterized, all frames
+  uint64_t tested;    // boxes tested, all frames
+  uint64_t culled;    // boxes found hidden, all frames
+};
+
+// Clears the buffer and rasterizes count occluders, occluder i placed by
+// models[i]
+void softOcclusionRender(SoftOcclusion *so, const glm::mat4 &view_projection, const OccluderMesh *const meshes[],
+                         const glm::mat4 models[], int count, ThreadPool *pool);
+
+// Removes from objects the ones whose box (bounds[object]) is hidden
+void softOcclusionFilter(SoftOcclusion *so, const glm::mat4 &view_projection, const Aabb bounds[],
+                         std::vector<int> *objects);
+
+#endif
@@ -4,7 +4,14 @@
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
 
 // GLM library to deal with matrix operations
 #include <glm/glm.hpp>
@@ -13,6 +20,23 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "textfile_ALT.h"
+#include "headless.h"
+#include "gpu_profiler.h"
+#include "trace.h"
+#include "mesh.h"
+#include "normals.h"
+#include "thread_pool.h"
+#include "mesh_import.h"
+#include "mesh_cache.h"
+#include "geometry_heap.h"
+#include "uniform_blocks.h"
+#include "gl_state.h"
+#include "instance_buffer.h"
+#include "draw_list.h"
+#include "scene_graph.h"
+#include "culling.h"
+#include "occlusion_queries.h"
+#include "software_occlusion.h"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -22,18 +46,22 @@ int gl_height = 480;
 
 void glfw_window_size_callback(GLFWwindow *window, int width, int height);
 void processInput(GLFWwindow *window);
-void render(double currentTime, GLuint *vaos[], unsigned int diffuse_map, unsigned int specular_map);
-void getAllNormals(GLfloat *normals, const GLfloat polygon[], const int size);
-void calcPolygon(const GLfloat vertex_positions[], const GLfloat coords_texture[], int size, int texture_size, GLuint *vao);
+void render(double currentTime, Mesh *meshes[], unsigned int diffuse_map, unsigned int specular_map);
+void calcPolygons(const MeshSource sources[], const uint64_t keys[], int count, Mesh *meshes[]);
+int selectLod(const Mesh &mesh, const glm::mat4 &model_matrix);
+void softOcclude(Mesh *meshes[], const glm::mat4 &view_projection);
 unsigned int loadTexture(char const *path);
+void finishGpuProfile(const char *csv_path);
 
 GLuint shader_program = 0; // shader program to set render pipeline
 
-GLint view_location, projection_location, model_location, normal_matrix_location;
-GLint lightPositionLocation, lightAmbientLocation, lightDiffuseLocation, lightSpecularLocation;
-GLint lightPositionLocation2, lightAmbientLocation2, lightDiffuseLocation2, lightSpecularLocation2;
-GLint materialDiffuseLocation, materialSpecularLocation, materialShininessLocation;
-GLint viewPosLocation;
+// CPU trace: written on exit if --trace is given, or any time with F12
+const char *trace_path = "trace.json";
+
+GLint positionOffsetLocation, positionScaleLocation;
+
+// Camera, lights and material for every program (uniform_blocks.h)
+UniformBuffer frame_uniforms;
 
 // Shader names
 const char *vertexFileName = "spinningcube_withlight_vs.glsl";
@@ -41,6 +69,7 @@ const char *fragmentFileName = "spinningcube_withlight_fs.glsl";
 
 // Camera
 glm::vec3 camera_pos(0.0f, 0.0f, 2.0f);
+float camera_fov = 50.0f; // vertical, degrees
 
 // Lighting
 struct Light
@@ -65,88 +94,409 @@ Light light2 = {
     glm::vec3(1.0f, 1.0f, 1.0f)   // specular
 };
 
-// Material
+// Materials: copy i of the pyramid + cube pair uses i % MAX_MATERIALS,
+// so the single default copy keeps the untinted one
 struct Material
 {
   float shininess;
+  glm::vec3 tint;
 };
 
-Material material = {
-    32.0f // shininess
+Material materials[MAX_MATERIALS] = {
+    {32.0f, glm::vec3(1.0f, 1.0f, 1.0f)},
+    {8.0f, glm::vec3(1.0f, 0.6f, 0.6f)},
+    {64.0f, glm::vec3(0.6f, 1.0f, 0.6f)},
+    {16.0f, glm::vec3(0.6f, 0.6f, 1.0f)},
+    {128.0f, glm::vec3(1.0f, 1.0f, 0.6f)},
+    {4.0f, glm::vec3(0.6f, 1.0f, 1.0f)},
+    {32.0f, glm::vec3(1.0f, 0.6f, 1.0f)},
+    {256.0f, glm::vec3(0.8f, 0.8f, 0.8f)},
 };
 
+static LightStd140 lightStd140(const Light &light)
+{
+  LightStd140 std140 = {glm::vec4(light.position, 1.0f), glm::vec4(light.ambient, 0.0f), glm::vec4(light.diffuse, 0.0f),
+                        glm::vec4(light.specular, 0.0f)};
+  return std140;
+}
+
 glm::vec3 translation(1.0f, 0.0f, 0.0f);
 
-void calcPolygon(const GLfloat vertex_positions[], const GLfloat coords_texture[], int size, int texture_size, GLuint *vao)
+// Copies of the pyramid + cube pair (--instances), on a grid spacing
+// apart; copy 0 is the original at the origin when there is only one
+int instance_count = 1;
+float instance_spacing = 3.0f;
+
+// Model matrices of every object of a frame (instance_buffer.h), drawn
+// through the draw list
+InstanceBuffer instance_buffer;
+DrawList draw_list;
+
+// Transforms (scene_graph.h): each copy is a static node at its grid
+// slot, with the spinning pyramid under it and the cube under the pyramid
+SceneGraph scene_graph;
+
+struct SceneObject
 {
+  int node;
+  int mesh; // index in render()'s meshes
+  GLuint material;
+};
 
-  // Vertex Array Object
-  glGenVertexArrays(1, vao);
-  glBindVertexArray(*vao);
+std::vector<SceneObject> scene_objects;
+std::vector<int> spinning_nodes; // one per copy, animated by render()
+
+// Frustum culling (culling.h, --cull): the BVH over the objects' world
+// bounds is refit whenever the scene graph moved something
+bool frustum_culling = true;
+Bvh scene_bvh;
+std::vector<Aabb> object_bounds;
+std::vector<int> visible_objects;
+uint64_t scene_updates_seen = ~0ull;
+uint64_t visible_total = 0;
+
+// Occlusion culling (occlusion_queries.h, --occlusion): objects the GPU
+// found hidden behind the depth of earlier frames are not drawn
+bool occlusion_culling = false;
+OcclusionQueries occlusion_queries;
+std::vector<int> occlusion_candidates;
+
+// Software occlusion culling (software_occlusion.h, --soft-occlusion): the
+// visible objects looking biggest from the camera are rasterized on the
+// CPU, up to soft_occluder_triangles, and hide what is behind them the
+// same frame
+bool soft_occlusion = false;
+int soft_occluder_triangles = 32768;
+SoftOcclusion soft_occlusion_buffer;
+std::vector<OccluderMesh> occluder_meshes; // of each mesh in render()'s meshes
+
+// Position of copy i: a cube of side^3 slots, centered in x and y, going
+// away from the camera in z
+static glm::vec3 instanceOffset(int i, int side)
+{
+  int x = i % side, y = (i / side) % side, z = i / (side * side);
+  float center = 0.5f * (side - 1);
+  return instance_spacing * glm::vec3(x - center, y - center, -z);
+}
+
+static int instanceGridSide(int count)
+{
+  int side = 1;
+  while (side * side * side < count)
+    side++;
+  return side;
+}
 
-  // Vertex Buffer Object (for vertex coordinates)
-  GLuint vbo = 0;
-  glGenBuffers(1, &vbo);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(GLfloat) * size, vertex_positions, GL_STATIC_DRAW);
+static void buildScene(int count)
+{
+  int side = instanceGridSide(count);
+  for (int i = 0; i < count; i++)
+  {
+    GLuint material = i % MAX_MATERIALS;
+    int slot = sceneAddNode(&scene_graph, -1, glm::translate(glm::mat4(1.f), instanceOffset(i, side)));
+    int pyramid = sceneAddNode(&scene_graph, slot, glm::mat4(1.f));
+    int cube = sceneAddNode(&scene_graph, pyramid, glm::translate(glm::mat4(1.f), translation));
+    spinning_nodes.push_back(pyramid);
+    SceneObject objects[] = {{pyramid, 0, material}, {cube, 1, material}};
+    scene_objects.insert(scene_objects.end(), objects, objects + 2);
+  }
+}
 
-  // Vertex attributes
-  // 0: vertex position (x, y, z)
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-  glEnableVertexAttribArray(0);
+// How calcPolygons() lays out vertex data on the GPU (--layout)
+VertexLayout vertex_layout = VERTEX_LAYOUT_INTERLEAVED;
 
-  // 1: vertex normals (x, y, z)
-  GLfloat normals[sizeof(GLfloat) * size] = {};
-  getAllNormals(normals, vertex_positions, size);
+// Vertex and element buffers of every mesh, one VAO for all of them
+GeometryHeap *geometry_heap = NULL;
 
-  GLuint normalsBuffer = 0;
-  glGenBuffers(1, &normalsBuffer);
-  glBindBuffer(GL_ARRAY_BUFFER, normalsBuffer);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(normals), normals, GL_STATIC_DRAW);
+// Smoothing of the mesh normals (--crease): 0 keeps them flat
+float crease_angle = 0.0f;
 
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-  glEnableVertexAttribArray(1);
+// Triangle / vertex reordering of the built meshes (--optimize)
+MeshOptimize mesh_optimize = MESH_OPTIMIZE_CACHE;
 
-  // Calculo texturas
-  GLuint texture_cords_buffer = 0;
-  glGenBuffers(1, &texture_cords_buffer);
-  glBindBuffer(GL_ARRAY_BUFFER, texture_cords_buffer);
-  glBufferData(GL_ARRAY_BUFFER, texture_size, coords_texture, GL_STATIC_DRAW);
+// Workers for CPU preprocessing (--threads)
+ThreadPool *worker_pool = NULL;
 
-  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
-  glEnableVertexAttribArray(2);
+// Built meshes are kept here between runs (--mesh-cache), NULL = disabled
+const char *mesh_cache_dir = ".mesh_cache";
 
-  // Unbind vbo (it was conveniently registered by VertexAttribPointer)
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  glBindBuffer(GL_ARRAY_BUFFER, 1);
+// Levels of detail built per mesh (--lods), the coarsest one whose error
+// stays under lod_pixel_error pixels on screen is drawn (--lod-error), or
+// always forced_lod when >= 0 (--lod)
+int lod_levels = MESH_MAX_LODS;
+float lod_pixel_error = 1.0f;
+int forced_lod = -1;
 
-  // Unbind vao
-  glBindVertexArray(0);
+static void setMeshLods(Mesh *mesh, const glm::vec3 &bounds_min, const glm::vec3 &bounds_max, int lod_count,
+                        const MeshLod lods[])
+{
+  mesh->bounds_min = bounds_min;
+  mesh->bounds_max = bounds_max;
+  mesh->lod_count = lod_count;
+  for (int l = 0; l < lod_count; l++)
+    mesh->lods[l] = lods[l];
 }
 
-int main()
+// Las mallas de la cache se suben directamente desde el fichero mapeado.
+// El resto: normales, vertices soldados e indices en los hilos del pool;
+// solo la subida a la GPU se hace en este hilo (el del contexto GL)
+void calcPolygons(const MeshSource sources[], const uint64_t keys[], int count, Mesh *meshes[])
 {
-  // start GL context and O/S window using the GLFW helper library
-  if (!glfwInit())
+  TRACE_SCOPE("calcPolygons");
+
+  // CPU copies of the meshes to occlude with, before the cache closes
+  if (soft_occlusion)
+    occluder_meshes.resize(count);
+  std::vector<int> missing;
+  for (int i = 0; i < count; i++)
   {
-    fprintf(stderr, "ERROR: could not start GLFW3\n");
-    return 1;
+    CachedMesh cached;
+    if (mesh_cache_dir && meshCacheOpen(mesh_cache_dir, keys[i], &cached))
+    {
+      printf("Mesh cache hit %016llx: %d vertices, %d indices\n", (unsigned long long)keys[i], cached.vertex_count,
+             cached.index_count);
+      geometryHeapUpload(geometry_heap, cached.vertices, cached.vertex_count, cached.indices, cached.index_count,
+                         meshes[i]);
+      setMeshLods(meshes[i], cached.bounds_min, cached.bounds_max, cached.lod_count, cached.lods);
+      if (soft_occlusion)
+        occluderMeshFrom(&occluder_meshes[i], cached.vertices, cached.vertex_count, cached.indices, cached.lod_count,
+                         cached.lods);
+      meshCacheClose(&cached);
+    }
+    else
+      missing.push_back(i);
   }
+  if (missing.empty())
+    return;
+
+  std::vector<MeshSource> missing_sources;
+  for (int i : missing)
+    missing_sources.push_back(sources[i]);
+  std::vector<MeshData> data(missing.size());
+  buildMeshes(missing_sources.data(), missing.size(), data.data(), worker_pool);
 
-  GLFWwindow *window = glfwCreateWindow(gl_width, gl_height, "My spinning cube", NULL, NULL);
-  if (!window)
+  printf("Mesh preprocessing: %d threads, normals kernel %s\n", threadPoolConcurrency(worker_pool), faceNormalsKernel());
+  for (size_t m = 0; m < missing.size(); m++)
   {
-    fprintf(stderr, "ERROR: could not open window with GLFW3\n");
-    glfwTerminate();
-    return 1;
+    int i = missing[m];
+    // Vertices shared by several triangles are stored (and shaded) once
+    printf("Welded vertices: %d -> %d\n", sources[i].size / 3, (int)data[m].vertices.size());
+    printf("Vertex cache ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", data[m].cache_before.acmr, data[m].cache_after.acmr,
+           data[m].cache_before.atvr, data[m].cache_after.atvr);
+    printf("Levels of detail:");
+    for (int l = 0; l < data[m].lod_count; l++)
+      printf(" %d", data[m].lods[l].index_count / 3);
+    printf(" triangles\n");
+    if (mesh_cache_dir)
+      meshCacheWrite(mesh_cache_dir, keys[i], data[m]);
+    geometryHeapUpload(geometry_heap, data[m].vertices.data(), data[m].vertices.size(), data[m].indices.data(),
+                       data[m].indices.size(), meshes[i]);
+    setMeshLods(meshes[i], data[m].bounds_min, data[m].bounds_max, data[m].lod_count, data[m].lods);
+    if (soft_occlusion)
+      occluderMeshFrom(&occluder_meshes[i], data[m].vertices.data(), data[m].vertices.size(), data[m].indices.data(),
+                       data[m].lod_count, data[m].lods);
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  // Command line options
+  // --headless: render offscreen (EGL + FBO), no window needed
+  // --frames N: number of frames to render in headless mode
+  // --gpu-profile FILE: time render() sections on the GPU, CSV dump on exit
+  // --trace FILE: write the CPU trace (Chrome JSON) on exit
+  // --layout interleaved|separate|packed: vertex buffer layout of the meshes
+  // --threads N: worker threads for mesh preprocessing (default one per core)
+  // --instances N: draw N pyramid + cube pairs with instancing
+  // --crease DEG: smooth normals between faces less than DEG degrees apart
+  // --mesh FILE: draw an OBJ or binary PLY model instead of the cube
+  // --mesh-cache DIR|off: where built meshes are kept (default .mesh_cache)
+  // --optimize none|cache|overdraw: reordering of triangles and vertices
+  // --lods N: levels of detail built per mesh (1 = none)
+  // --lod-error PX: screen error allowed when choosing a level
+  // --lod L: always draw level L (clamped to the levels a mesh has)
+  // --cull on|off: skip objects outside the view frustum (default on)
+  // --occlusion on|off: skip objects GPU queries found hidden (default off)
+  // --soft-occlusion on|off: skip objects hidden in a CPU depth buffer (default off)
+  bool headless = false;
+  int frames = 1000;
+  const char *gpu_profile_csv = NULL;
+  bool trace_on_exit = false;
+  int threads = 0;
+  const char *mesh_path = NULL;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--headless") == 0)
+      headless = true;
+    else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+      frames = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--gpu-profile") == 0 && i + 1 < argc)
+      gpu_profile_csv = argv[++i];
+    else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+    {
+      trace_path = argv[++i];
+      trace_on_exit = true;
+    }
+    else if (strcmp(argv[i], "--layout") == 0 && i + 1 < argc && strcmp(argv[i + 1], "separate") == 0)
+    {
+      vertex_layout = VERTEX_LAYOUT_SEPARATE;
+      i++;
+    }
+    else if (strcmp(argv[i], "--layout") == 0 && i + 1 < argc && strcmp(argv[i + 1], "interleaved") == 0)
+    {
+      vertex_layout = VERTEX_LAYOUT_INTERLEAVED;
+      i++;
+    }
+    else if (strcmp(argv[i], "--layout") == 0 && i + 1 < argc && strcmp(argv[i + 1], "packed") == 0)
+    {
+      vertex_layout = VERTEX_LAYOUT_PACKED;
+      i++;
+    }
+    else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+      instance_count = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+      threads = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--crease") == 0 && i + 1 < argc)
+      crease_angle = atof(argv[++i]);
+    else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc)
+      mesh_path = argv[++i];
+    else if (strcmp(argv[i], "--optimize") == 0 && i + 1 < argc && strcmp(argv[i + 1], "none") == 0)
+    {
+      mesh_optimize = MESH_OPTIMIZE_NONE;
+      i++;
+    }
+    else if (strcmp(argv[i], "--optimize") == 0 && i + 1 < argc && strcmp(argv[i + 1], "cache") == 0)
+    {
+      mesh_optimize = MESH_OPTIMIZE_CACHE;
+      i++;
+    }
+    else if (strcmp(argv[i], "--optimize") == 0 && i + 1 < argc && strcmp(argv[i + 1], "overdraw") == 0)
+    {
+      mesh_optimize = MESH_OPTIMIZE_OVERDRAW;
+      i++;
+    }
+    else if (strcmp(argv[i], "--lods") == 0 && i + 1 < argc)
+      lod_levels = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--lod-error") == 0 && i + 1 < argc)
+      lod_pixel_error = atof(argv[++i]);
+    else if (strcmp(argv[i], "--lod") == 0 && i + 1 < argc)
+      forced_lod = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--cull") == 0 && i + 1 < argc && strcmp(argv[i + 1], "on") == 0)
+    {
+      frustum_culling = true;
+      i++;
+    }
+    else if (strcmp(argv[i], "--cull") == 0 && i + 1 < argc && strcmp(argv[i + 1], "off") == 0)
+    {
+      frustum_culling = false;
+      i++;
+    }
+    else if (strcmp(argv[i], "--occlusion") == 0 && i + 1 < argc && strcmp(argv[i + 1], "on") == 0)
+    {
+      occlusion_culling = true;
+      i++;
+    }
+    else if (strcmp(argv[i], "--occlusion") == 0 && i + 1 < argc && strcmp(argv[i + 1], "off") == 0)
+    {
+      occlusion_culling = false;
+      i++;
+    }
+    else if (strcmp(argv[i], "--soft-occlusion") == 0 && i + 1 < argc && strcmp(argv[i + 1], "on") == 0)
+    {
+      soft_occlusion = true;
+      i++;
+    }
+    else if (strcmp(argv[i], "--soft-occlusion") == 0 && i + 1 < argc && strcmp(argv[i + 1], "off") == 0)
+    {
+      soft_occlusion = false;
+      i++;
+    }
+    else if (strcmp(argv[i], "--mesh-cache") == 0 && i + 1 < argc)
+    {
+      mesh_cache_dir = argv[++i];
+      if (strcmp(mesh_cache_dir, "off") == 0)
+        mesh_cache_dir = NULL;
+    }
+    else
+    {
+      fprintf(stderr, "Usage: %s [--headless] [--frames N] [--gpu-profile FILE] [--trace FILE]\n"
+                      "          [--layout interleaved|separate|packed] [--threads N] [--crease DEG]\n"
+                      "          [--mesh FILE.obj|FILE.ply] [--mesh-cache DIR|off]\n"
+                      "          [--optimize none|cache|overdraw] [--lods N] [--lod-error PX] [--lod L]\n"
+                      "          [--instances N] [--cull on|off] [--occlusion on|off] [--soft-occlusion on|off]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+
+  // Back the camera off until the whole grid of copies fits the view
+  if (instance_count > 1)
+  {
+    float half = 0.5f * instance_spacing * (instanceGridSide(instance_count) - 1) + 1.5f;
+    camera_pos.z = glm::max(camera_pos.z, half / tanf(glm::radians(camera_fov) * 0.5f) + 1.5f);
+  }
+
+  // Parsing big models does not need the GL context: done before it
+  // exists. The model is keyed by its file contents, so a cache hit skips
+  // the import too.
+  worker_pool = threadPoolCreate(threads);
+  ImportedMesh imported;
+  uint64_t mesh_key = 0;
+  const MeshSource build_options = {NULL, NULL, 0, crease_angle, mesh_optimize, lod_levels};
+  if (mesh_path)
+  {
+    CachedMesh cached;
+    bool in_cache = false;
+    bool ok = meshFileKey(mesh_path, build_options, worker_pool, &mesh_key);
+    if (ok && mesh_cache_dir && meshCacheOpen(mesh_cache_dir, mesh_key, &cached))
+    {
+      meshCacheClose(&cached);
+      in_cache = true;
+    }
+    if (!ok || (!in_cache && !importMesh(mesh_path, &imported, worker_pool)))
+    {
+      threadPoolDestroy(worker_pool);
+      return 1;
+    }
+  }
+
+  GLFWwindow *window = NULL;
+  if (headless)
+  {
+    // start GL context without any O/S window
+    if (!headlessInit())
+      return 1;
+  }
+  else
+  {
+    // start GL context and O/S window using the GLFW helper library
+    if (!glfwInit())
+    {
+      fprintf(stderr, "ERROR: could not start GLFW3\n");
+      return 1;
+    }
+
+    window = glfwCreateWindow(gl_width, gl_height, "My spinning cube", NULL, NULL);
+    if (!window)
+    {
+      fprintf(stderr, "ERROR: could not open window with GLFW3\n");
+      glfwTerminate();
+      return 1;
+    }
+    glfwSetWindowSizeCallback(window, glfw_window_size_callback);
+    glfwMakeContextCurrent(window);
   }
-  glfwSetWindowSizeCallback(window, glfw_window_size_callback);
-  glfwMakeContextCurrent(window);
 
   // start GLEW extension handler
   // glewExperimental = GL_TRUE;
   glewInit();
 
+  if (headless && !headlessCreateFramebuffer(gl_width, gl_height))
+  {
+    headlessTerminate();
+    return 1;
+  }
+
   // get version info
   const GLubyte *vendor = glGetString(GL_VENDOR);                        // get vendor string
   const GLubyte *renderer = glGetString(GL_RENDERER);                    // get renderer string
@@ -162,6 +512,8 @@ int main()
   glEnable(GL_DEPTH_TEST);
   glDepthFunc(GL_LESS); // set a smaller value as "closer"
 
+  uint64_t compile_start = traceNow();
+
   // Vertex Shader
   char *vertex_shader = textFileRead(vertexFileName);
 
@@ -203,6 +555,14 @@ int main()
   shader_program = glCreateProgram();
   glAttachShader(shader_program, fs);
   glAttachShader(shader_program, vs);
+
+  // Same attribute locations the mesh VAOs use
+  glBindAttribLocation(shader_program, ATTRIB_POSITION, "v_pos");
+  glBindAttribLocation(shader_program, ATTRIB_NORMAL, "v_normal");
+  glBindAttribLocation(shader_program, ATTRIB_TEXCOORD, "v_texture");
+  glBindAttribLocation(shader_program, ATTRIB_INSTANCE_MODEL, "instance_model");
+  glBindAttribLocation(shader_program, ATTRIB_INSTANCE_NORMAL, "instance_normal_matrix");
+  glBindAttribLocation(shader_program, ATTRIB_INSTANCE_MATERIAL, "instance_material");
   glLinkProgram(shader_program);
 
   glValidateProgram(shader_program);
@@ -215,10 +575,14 @@ int main()
     return (1);
   }
 
+  bindUniformBlocks(shader_program);
+
   // Release shader objects
   glDeleteShader(vs);
   glDeleteShader(fs);
 
+  traceRecord("compile shaders", compile_start, traceNow());
+
   // Cube to be rendered
   //
   //          0        3
@@ -347,45 +711,43 @@ int main()
       1.0f, 1.0f  // 3
   };
 
-  GLuint cubeVao;    // Vertext Array Object to set input data
-  GLuint pyramidVao; // Vertext Array Object to set input data
-
-  int vertexCount = sizeof(vertex_positions_pyramid) / sizeof(vertex_positions_pyramid[0]);
-
-  calcPolygon(vertex_positions_pyramid, coords_texture_cube, vertexCount, sizeof(coords_texture_cube), &pyramidVao);
-
-  vertexCount = sizeof(vertex_positions_cube) / sizeof(vertex_positions_cube[0]);
-
-  calcPolygon(vertex_positions_cube, coords_texture_cube, vertexCount, sizeof(coords_texture_cube), &cubeVao);
-
-  GLuint *vaos[] = {&pyramidVao, &cubeVao};
-
-  // Uniforms
-  // - Model matrix
-  model_location = glGetUniformLocation(shader_program, "model");
-  // - View matrix
-  view_location = glGetUniformLocation(shader_program, "view");
-  // - Projection matrix
-  projection_location = glGetUniformLocation(shader_program, "projection");
-  // - Normal matrix: normal vectors from local to world coordinates
-  normal_matrix_location = glGetUniformLocation(shader_program, "normal_matrix");
-  // - Camera position
-  // - Light data
-  lightPositionLocation = glGetUniformLocation(shader_program, "light.position");
-  lightAmbientLocation = glGetUniformLocation(shader_program, "light.ambient");
-  lightDiffuseLocation = glGetUniformLocation(shader_program, "light.diffuse");
-  lightSpecularLocation = glGetUniformLocation(shader_program, "light.specular");
-
-  lightPositionLocation2 = glGetUniformLocation(shader_program, "light2.position");
-  lightAmbientLocation2 = glGetUniformLocation(shader_program, "light2.ambient");
-  lightDiffuseLocation2 = glGetUniformLocation(shader_program, "light2.diffuse");
-  lightSpecularLocation2 = glGetUniformLocation(shader_program, "light2.specular");
-  // - Material data
-  materialShininessLocation = glGetUniformLocation(shader_program, "material.shininess");
-  materialDiffuseLocation = glGetUniformLocation(shader_program, "material.diffuse");
-  materialSpecularLocation = glGetUniformLocation(shader_program, "material.specular");
-  // [...]
-  viewPosLocation = glGetUniformLocation(shader_program, "view_pos");
+  Mesh cubeMesh;    // ranges of the geometry heap to draw
+  Mesh pyramidMesh; // ranges of the geometry heap to draw
+
+  Mesh *meshes[] = {&pyramidMesh, &cubeMesh};
+
+  MeshSource sources[] = {
+      {vertex_positions_pyramid, coords_texture_cube, sizeof(vertex_positions_pyramid) / sizeof(vertex_positions_pyramid[0]), crease_angle, mesh_optimize, lod_levels},
+      {vertex_positions_cube, coords_texture_cube, sizeof(vertex_positions_cube) / sizeof(vertex_positions_cube[0]), crease_angle, mesh_optimize, lod_levels}};
+
+  uint64_t keys[] = {meshSourceKey(sources[0], worker_pool), meshSourceKey(sources[1], worker_pool)};
+  if (mesh_path)
+  {
+    sources[1] = importedMeshSource(imported, build_options);
+    keys[1] = mesh_key;
+  }
+  geometry_heap = geometryHeapCreate(vertex_layout);
+  calcPolygons(sources, keys, 2, meshes);
+  instanceBufferCreate(&instance_buffer, geometry_heap->vao);
+  drawListCreate(&draw_list);
+  buildScene(instance_count);
+  if (occlusion_culling && !occlusionCreate(&occlusion_queries, "occlusion_box_vs.glsl", "occlusion_box_fs.glsl"))
+  {
+    fprintf(stderr, "ERROR: occlusion culling disabled\n");
+    occlusion_culling = false;
+  }
+
+  // Uniforms: camera, lights and material are in the uniform blocks, the
+  // model matrices in the instance buffer
+  uniformBufferCreate(&frame_uniforms);
+  // - Vertex decoding (packed layout)
+  positionOffsetLocation = glGetUniformLocation(shader_program, "position_offset");
+  positionScaleLocation = glGetUniformLocation(shader_program, "position_scale");
+  // - Never change: texture units and the normal encoding
+  stateUseProgram(shader_program);
+  stateUniform1i(glGetUniformLocation(shader_program, "diffuse_map"), 0);
+  stateUniform1i(glGetUniformLocation(shader_program, "specular_map"), 1);
+  stateUniform1i(glGetUniformLocation(shader_program, "octahedral_normals"), vertex_layout == VERTEX_LAYOUT_PACKED);
 
   // Textura mapa difuso
   unsigned int diffuse_map = loadTexture("./textures/container2.png");
@@ -393,107 +755,326 @@ int main()
   // Textura mapa especular
   unsigned int specular_map = loadTexture("./textures/container2_specular.png");
 
+  if (gpu_profile_csv)
+    gpuProfilerInit();
+
+  if (headless)
+  {
+    // Benchmark loop: fixed 60 Hz animation time so every run draws the
+    // same frames, glFinish so each sample covers the whole GPU work
+    std::vector<double> frame_times(frames > 0 ? frames : 0);
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; i++)
+    {
+      TRACE_SCOPE("frame");
+      auto frame_start = std::chrono::steady_clock::now();
+
+      {
+        TRACE_SCOPE("render");
+        render(i / 60.0, meshes, diffuse_map, specular_map);
+      }
+      {
+        TRACE_SCOPE("glFinish");
+        glFinish();
+      }
+
+      frame_times[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - frame_start).count();
+    }
+    double total_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printFrameStats(frame_times.data(), frames, total_time);
+    statePrintStats(frames);
+    if (frames > 0)
+      printf("Scene graph: %d nodes, %.1f world matrices updated per frame\n", (int)scene_graph.parent.size(),
+             (double)scene_graph.updates / frames);
+    if (frames > 0 && frustum_culling)
+      printf("Frustum culling (%s kernel): %.1f of %d objects visible per frame\n", cullingKernel(),
+             (double)visible_total / frames, (int)scene_objects.size());
+    if (frames > 0 && occlusion_culling)
+      printf("Occlusion queries: %.1f boxes tested, %.1f objects culled per frame\n",
+             (double)occlusion_queries.tested / frames, (double)occlusion_queries.culled / frames);
+    if (frames > 0 && soft_occlusion)
+      printf("Software occlusion (%dx%d): %.1f occluders, %.1f of %.1f objects culled per frame\n",
+             SOFT_OCCLUSION_WIDTH, SOFT_OCCLUSION_HEIGHT, (double)soft_occlusion_buffer.occluders / frames,
+             (double)soft_occlusion_buffer.culled / frames, (double)soft_occlusion_buffer.tested / frames);
+
+    finishGpuProfile(gpu_profile_csv);
+    if (trace_on_exit)
+      traceWriteJson(trace_path);
+    threadPoolDestroy(worker_pool);
+    geometryHeapDestroy(geometry_heap);
+    if (occlusion_culling)
+      occlusionDestroy(&occlusion_queries);
+    drawListDestroy(&draw_list);
+    instanceBufferDestroy(&instance_buffer);
+    uniformBufferDestroy(&frame_uniforms);
+    headlessTerminate();
+
+    return 0;
+  }
+
   // Render loop
   while (!glfwWindowShouldClose(window))
   {
-
-    processInput(window);
-
-    render(glfwGetTime(), vaos, diffuse_map, specular_map);
-
-    glfwSwapBuffers(window);
-
-    glfwPollEvents();
+    TRACE_SCOPE("frame");
+    {
+      TRACE_SCOPE("processInput");
+      processInput(window);
+    }
+    {
+      TRACE_SCOPE("render");
+      render(glfwGetTime(), meshes, diffuse_map, specular_map);
+    }
+    {
+      TRACE_SCOPE("glfwSwapBuffers");
+      glfwSwapBuffers(window);
+    }
+    {
+      TRACE_SCOPE("glfwPollEvents");
+      glfwPollEvents();
+    }
   }
 
+  finishGpuProfile(gpu_profile_csv);
+  if (trace_on_exit)
+    traceWriteJson(trace_path);
+  threadPoolDestroy(worker_pool);
+  geometryHeapDestroy(geometry_heap);
+  if (occlusion_culling)
+    occlusionDestroy(&occlusion_queries);
+  drawListDestroy(&draw_list);
+  instanceBufferDestroy(&instance_buffer);
+  uniformBufferDestroy(&frame_uniforms);
   glfwTerminate();
 
   return 0;
 }
 
-void render(double currentTime, GLuint *vaos[], unsigned int diffuse_map, unsigned int specular_map)
+void render(double currentTime, Mesh *meshes[], unsigned int diffuse_map, unsigned int specular_map)
 {
-  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  gpuProfilerBeginFrame();
 
-  glViewport(0, 0, gl_width, gl_height);
+  gpuProfilerBegin(GPU_SECTION_CLEAR);
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  gpuProfilerEnd(GPU_SECTION_CLEAR);
 
-  glUseProgram(shader_program);
-  glBindVertexArray(*vaos[0]);
+  gpuProfilerBegin(GPU_SECTION_UNIFORMS);
+  // Binds and uniforms go through gl_state.h: what did not change since
+  // the last frame (or the last object) is skipped
+  stateViewport(0, 0, gl_width, gl_height);
 
-  glm::mat4 model_matrix, view_matrix, proj_matrix;
-  glm::mat3 normal_matrix;
+  stateUseProgram(shader_program);
+  stateBindVertexArray(geometry_heap->vao);
 
-  model_matrix = glm::mat4(1.f);
+  glm::mat4 view_matrix, proj_matrix;
 
   // Camara
   view_matrix = glm::lookAt(camera_pos,                   // pos
                             glm::vec3(0.0f, 0.0f, 0.0f),  // target
                             glm::vec3(0.0f, 1.0f, 0.0f)); // up
 
-  // Moving cube
-  // Teniendo en cuenta el tiempo actual, se rota el cubo tanto horizontal
-  // como verticalmente
-  model_matrix = glm::rotate(model_matrix,
-                             glm::radians((float)currentTime * 30.0f),
-                             glm::vec3(0.0f, 1.0f, 0.0f));
-
-  model_matrix = glm::rotate(model_matrix,
-                             glm::radians((float)currentTime * 81.0f),
-                             glm::vec3(1.0f, 0.0f, 0.0f));
-
   // Projection
-  proj_matrix = glm::perspective(glm::radians(50.0f),
+  proj_matrix = glm::perspective(glm::radians(camera_fov),
                                  (float)gl_width / (float)gl_height,
                                  0.1f, 1000.0f);
 
-  glUniformMatrix4fv(view_location, 1, GL_FALSE, glm::value_ptr(view_matrix));
-  glUniformMatrix4fv(model_location, 1, GL_FALSE, glm::value_ptr(model_matrix));
-  glUniformMatrix4fv(projection_location, 1, GL_FALSE, glm::value_ptr(proj_matrix));
-
-  // Normal matrix: normal vectors to world coordinates
-  normal_matrix = glm::transpose(glm::inverse(glm::mat3(model_matrix)));
-  glUniformMatrix3fv(normal_matrix_location, 1, GL_FALSE, glm::value_ptr(normal_matrix));
-
-  // Enviar los valores de light y material al programa de sombreado
-  glUniform3fv(lightPositionLocation, 1, glm::value_ptr(light.position));
-  glUniform3fv(lightAmbientLocation, 1, glm::value_ptr(light.ambient));
-  glUniform3fv(lightDiffuseLocation, 1, glm::value_ptr(light.diffuse));
-  glUniform3fv(lightSpecularLocation, 1, glm::value_ptr(light.specular));
+  // Frame constants: one upload for camera, lights and material
+  CameraBlock camera = {view_matrix, proj_matrix, glm::vec4(camera_pos, 1.0f)};
+  LightsBlock lights = {{lightStd140(light), lightStd140(light2)}};
+  MaterialBlock material_block;
+  for (int m = 0; m < MAX_MATERIALS; m++)
+  {
+    MaterialStd140 std140 = {glm::vec4(materials[m].tint, 1.0f), materials[m].shininess, {0.0f, 0.0f, 0.0f}};
+    material_block.materials[m] = std140;
+  }
+  uniformBufferSet(&frame_uniforms, UNIFORM_BLOCK_CAMERA, &camera, sizeof(camera));
+  uniformBufferSet(&frame_uniforms, UNIFORM_BLOCK_LIGHTS, &lights, sizeof(lights));
+  uniformBufferSet(&frame_uniforms, UNIFORM_BLOCK_MATERIAL, &material_block, sizeof(material_block));
+  uniformBufferUpload(&frame_uniforms);
 
-  glUniform3fv(lightPositionLocation2, 1, glm::value_ptr(light2.position));
-  glUniform3fv(lightAmbientLocation2, 1, glm::value_ptr(light2.ambient));
-  glUniform3fv(lightDiffuseLocation2, 1, glm::value_ptr(light2.diffuse));
-  glUniform3fv(lightSpecularLocation2, 1, glm::value_ptr(light2.specular));
+  // Moving cube
+  // Teniendo en cuenta el tiempo actual, se rota el cubo tanto horizontal
+  // como verticalmente (cada copia con su propio desfase); the cube follows
+  // through the scene graph
+  for (size_t i = 0; i < spinning_nodes.size(); i++)
+  {
+    float time = (float)currentTime + 0.25f * i;
+    glm::mat4 model_matrix = glm::rotate(glm::mat4(1.f),
+                                         glm::radians(time * 30.0f),
+                                         glm::vec3(0.0f, 1.0f, 0.0f));
+
+    model_matrix = glm::rotate(model_matrix,
+                               glm::radians(time * 81.0f),
+                               glm::vec3(1.0f, 0.0f, 0.0f));
+    sceneSetLocal(&scene_graph, spinning_nodes[i], model_matrix);
+  }
+  sceneUpdate(&scene_graph);
 
-  glUniform1f(materialShininessLocation, material.shininess);
-  glUniform1i(materialDiffuseLocation, 0);
-  glUniform1i(materialSpecularLocation, 1);
+  // Visible objects
+  visible_objects.clear();
+  if ((frustum_culling || occlusion_culling || soft_occlusion) && scene_updates_seen != scene_graph.updates)
+  {
+    object_bounds.resize(scene_objects.size());
+    for (size_t o = 0; o < scene_objects.size(); o++)
+    {
+      const Mesh &mesh = *meshes[scene_objects[o].mesh];
+      Aabb box = {mesh.bounds_min, mesh.bounds_max};
+      object_bounds[o] = transformAabb(box, scene_graph.world[scene_objects[o].node]);
+    }
+    if (frustum_culling && (scene_bvh.objects != (int)object_bounds.size() || scene_bvh.nodes.empty()))
+      bvhBuild(&scene_bvh, object_bounds.data(), object_bounds.size());
+    else if (frustum_culling)
+      bvhRefit(&scene_bvh, object_bounds.data());
+    scene_updates_seen = scene_graph.updates;
+  }
+  if (frustum_culling)
+  {
+    bvhCull(&scene_bvh, frustumFromMatrix(proj_matrix * view_matrix), &visible_objects);
+    visible_total += visible_objects.size();
+  }
+  else
+  {
+    for (size_t o = 0; o < scene_objects.size(); o++)
+      visible_objects.push_back(o);
+  }
+  if (soft_occlusion)
+    softOcclude(meshes, proj_matrix * view_matrix);
+  // Every object still visible is queried again, hidden or not
+  if (occlusion_culling)
+  {
+    occlusionResolve(&occlusion_queries);
+    occlusion_candidates = visible_objects;
+    occlusionFilter(&occlusion_queries, &visible_objects);
+  }
 
-  glUniform3fv(viewPosLocation, 1, glm::value_ptr(camera_pos));
+  // Objects, sorted by state and then front to back: packed vertices need
+  // each mesh's decoding uniforms, so each mesh is its own bucket;
+  // otherwise one bucket draws everything. shader_program is program 0.
+  bool per_mesh_state = vertex_layout == VERTEX_LAYOUT_PACKED;
+  drawListClear(&draw_list);
+  for (int o : visible_objects)
+  {
+    const SceneObject &object = scene_objects[o];
+    const Mesh &mesh = *meshes[object.mesh];
+    const glm::mat4 &world = scene_graph.world[object.node];
+    float depth = glm::length(glm::vec3(world[3]) - camera_pos);
+    drawListAdd(&draw_list, 0, per_mesh_state ? object.mesh : 0, object.mesh, mesh, selectLod(mesh, world), depth,
+                world, scene_graph.normal[object.node], object.material);
+  }
+  drawListBuild(&draw_list, &instance_buffer);
 
   // diffuse_map
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, diffuse_map);
+  stateBindTexture2D(0, diffuse_map);
 
   // specular_map
-  glActiveTexture(GL_TEXTURE1);
-  glBindTexture(GL_TEXTURE_2D, specular_map);
+  stateBindTexture2D(1, specular_map);
+  gpuProfilerEnd(GPU_SECTION_UNIFORMS);
 
-  glDrawArrays(GL_TRIANGLES, 0, 36);
+  gpuProfilerBegin(GPU_SECTION_DRAWS);
+  for (size_t b = 0; b < draw_list.batches.size(); b++)
+  {
+    const DrawBatch &batch = draw_list.batches[b];
+    stateUseProgram(shader_program);
+    stateUniform3f(positionOffsetLocation, batch.mesh->position_offset);
+    stateUniform3f(positionScaleLocation, batch.mesh->position_scale);
+    drawListSubmit(&draw_list, &instance_buffer, b);
+  }
+  gpuProfilerEnd(GPU_SECTION_DRAWS);
+
+  if (occlusion_culling)
+  {
+    gpuProfilerBegin(GPU_SECTION_OCCLUSION);
+    occlusionIssue(&occlusion_queries, occlusion_candidates, object_bounds.data(), camera_pos);
+    gpuProfilerEnd(GPU_SECTION_OCCLUSION);
+  }
+
+  gpuProfilerEndFrame();
+}
 
-  model_matrix = glm::translate(model_matrix, translation);
+// Rasterizes the visible objects that look biggest from the camera and
+// drops the visible objects they hide
+void softOcclude(Mesh *meshes[], const glm::mat4 &view_projection)
+{
+  TRACE_SCOPE("softOcclude");
 
-  glUniformMatrix4fv(model_location, 1, GL_FALSE, glm::value_ptr(model_matrix));
+  static std::vector<std::pair<float, int>> by_size;
+  by_size.clear();
+  for (int o : visible_objects)
+  {
+    const Aabb &box = object_bounds[o];
+    glm::vec3 center = 0.5f * (box.min + box.max);
+    float radius = 0.5f * glm::length(box.max - box.min);
+    float distance = glm::max(glm::length(center - camera_pos), 1e-3f);
+    by_size.push_back(std::make_pair(-radius / distance, o));
+  }
+  std::sort(by_size.begin(), by_size.end());
+
+  static std::vector<const OccluderMesh *> occluders;
+  static std::vector<glm::mat4> models;
+  occluders.clear();
+  models.clear();
+  int triangles = 0;
+  for (const std::pair<float, int> &candidate : by_size)
+  {
+    const SceneObject &object = scene_objects[candidate.second];
+    const OccluderMesh *occluder = &occluder_meshes[object.mesh];
+    triangles += occluder->indices.size() / 3;
+    if (triangles > soft_occluder_triangles)
+      break;
+    occluders.push_back(occluder);
+    models.push_back(scene_graph.world[object.node]);
+  }
+  softOcclusionRender(&soft_occlusion_buffer, view_projection, occluders.data(), models.data(), occluders.size(),
+                      worker_pool);
+  softOcclusionFilter(&soft_occlusion_buffer, view_projection, object_bounds.data(), &visible_objects);
+}
+
+// Coarsest level whose error, projected at the distance of the mesh's
+// bounding sphere, stays under lod_pixel_error pixels
+int selectLod(const Mesh &mesh, const glm::mat4 &model_matrix)
+{
+  if (forced_lod >= 0)
+    return forced_lod < mesh.lod_count ? forced_lod : mesh.lod_count - 1;
+
+  glm::vec3 center = glm::vec3(model_matrix * glm::vec4(0.5f * (mesh.bounds_min + mesh.bounds_max), 1.0f));
+  float scale = glm::max(glm::length(glm::vec3(model_matrix[0])),
+                         glm::max(glm::length(glm::vec3(model_matrix[1])), glm::length(glm::vec3(model_matrix[2]))));
+  float radius = 0.5f * glm::length(mesh.bounds_max - mesh.bounds_min) * scale;
+  float distance = glm::length(center - camera_pos) - radius;
+  if (distance <= 0.0f)
+    return 0;
+
+  // Pixels per world unit at that distance
+  float pixels = gl_height / (2.0f * distance * tanf(glm::radians(camera_fov) * 0.5f));
+  for (int l = mesh.lod_count - 1; l > 0; l--)
+    if (mesh.lods[l].error * scale * pixels <= lod_pixel_error)
+      return l;
+  return 0;
+}
 
-  glBindVertexArray(*vaos[1]);
+// Prints the GPU section averages and writes the per-frame CSV
+void finishGpuProfile(const char *csv_path)
+{
+  if (!gpuProfilerEnabled())
+    return;
 
-  glDrawArrays(GL_TRIANGLES, 0, 36);
+  gpuProfilerTerminate();
+  gpuProfilerPrintAverages();
+  if (gpuProfilerDumpCsv(csv_path))
+    printf("GPU profile written to %s\n", csv_path);
 }
 
 void processInput(GLFWwindow *window)
 {
   if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
     glfwSetWindowShouldClose(window, 1);
+
+  // F12: dump the CPU trace recorded so far (once per key press)
+  static bool trace_key_down = false;
+  bool key_down = glfwGetKey(window, GLFW_KEY_F12) == GLFW_PRESS;
+  if (key_down && !trace_key_down)
+    traceWriteJson(trace_path);
+  trace_key_down = key_down;
 }
 
 // Callback function to track window size and update viewport
@@ -504,41 +1085,9 @@ void glfw_window_size_callback(GLFWwindow *window, int width, int height)
   printf("New viewport: (width: %d, height: %d)\n", width, height);
 }
 
-// Obtenemos las normales de todo el poligono
-// size es la longitud del array del poligono
-void getAllNormals(GLfloat *normals, const GLfloat polygon[], const int size)
-{
-  printf("Tamaño: %d\n", size);
-  for (int i = 0; i < size; i += 9)
-  {
-
-    GLfloat v1[] = {polygon[i], polygon[i + 1], polygon[i + 2]};
-    GLfloat v2[] = {polygon[i + 3], polygon[i + 4], polygon[i + 5]};
-    GLfloat v3[] = {polygon[i + 6], polygon[i + 7], polygon[i + 8]};
-
-    GLfloat U[] = {v2[0] - v1[0], v2[1] - v1[1], v2[2] - v1[2]};
-    GLfloat V[] = {v3[0] - v1[0], v3[1] - v1[1], v3[2] - v1[2]};
-
-    GLfloat x = U[1] * V[2] - U[2] * V[1];
-    GLfloat y = U[2] * V[0] - U[0] * V[2];
-    GLfloat z = U[0] * V[1] - U[1] * V[0];
-
-    normals[i] = x;
-    normals[i + 3] = x;
-    normals[i + 6] = x;
-
-    normals[i + 1] = y;
-    normals[i + 4] = y;
-    normals[i + 7] = y;
-
-    normals[i + 2] = z;
-    normals[i + 5] = z;
-    normals[i + 8] = z;
-  }
-}
-
 unsigned int loadTexture(char const *path)
 {
+  TRACE_SCOPE("loadTexture");
   unsigned int textureID;
   glGenTextures(1, &textureID);
   int width, height, nrComponents;
@@ -552,7 +1101,7 @@ unsigned int loadTexture(char const *path)
       format = GL_RGB;
     else if (nrComponents == 4)
       format = GL_RGBA;
-    glBindTexture(GL_TEXTURE_2D, textureID);
+    stateBindTexture2D(0, textureID);
     glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
     glGenerateMipmap(GL_TEXTURE_2D);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
@@ -5,12 +5,7 @@ out vec4 frag_col;
 in vec3 normal;
 in vec3 frag_3Dpos;
 in vec2 TexCoords;
-
-struct Material {
-    sampler2D diffuse;
-    sampler2D specular;
-    float shininess;
-};
+flat in uint material_index;
 
 struct Light {
     vec3 position;
@@ -19,44 +14,64 @@ struct Light {
     vec3 specular;
 };
 
-uniform Material material;
-uniform Light light;
-uniform Light light2;
+// Frame constants (uniform_blocks.h)
+layout(std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    vec3 view_pos;
+};
+
+layout(std140) uniform Lights {
+    Light lights[2];
+};
+
+struct MaterialData {
+    vec4 tint;
+    float shininess;
+};
+
+layout(std140) uniform Material {
+    MaterialData materials[8];
+};
 
-uniform vec3 view_pos;
+// Texture units 0 and 1
+uniform sampler2D diffuse_map;
+uniform sampler2D specular_map;
 
 void main() {
+    MaterialData material = materials[material_index];
+
     // ambient
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
+    vec3 ambient = lights[0].ambient * vec3(texture(diffuse_map, TexCoords));
 
-    vec3 light_dir  = normalize(light.position - frag_3Dpos);
+    vec3 light_dir  = normalize(lights[0].position - frag_3Dpos);
     // diffuse 
     float diff = max(dot(normal, light_dir), 0.0);
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
+    vec3 diffuse = lights[0].diffuse * diff * vec3(texture(diffuse_map, TexCoords));
 
     // specular
     vec3 view_dir = normalize(view_pos - frag_3Dpos);
     vec3 reflect_dir = reflect(-light_dir, normal);
     float spec = pow(max(dot(view_dir, reflect_dir), 0.0), material.shininess);
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 specular = lights[0].specular * spec * vec3(texture(specular_map, TexCoords));
 
 
     // ambient 2
-    vec3 ambient2 = light2.ambient * vec3(texture(material.diffuse, TexCoords));
+    vec3 ambient2 = lights[1].ambient * vec3(texture(diffuse_map, TexCoords));
 
-    vec3 light2_dir  = normalize(light2.position - frag_3Dpos);
+    vec3 light2_dir  = normalize(lights[1].position - frag_3Dpos);
     // diffuse 2
     float diff2 = max(dot(normal, light2_dir), 0.0);
-    vec3 diffuse2 = light2.diffuse * diff2 * vec3(texture(material.diffuse, TexCoords));
+    vec3 diffuse2 = lights[1].diffuse * diff2 * vec3(texture(diffuse_map, TexCoords));
 
     // specular 2
     vec3 view_dir2 = normalize(view_pos - frag_3Dpos);
     vec3 reflect_dir2 = reflect(-light2_dir, normal);
     float spec2 = pow(max(dot(view_dir2, reflect_dir2), 0.0), material.shininess);
-    vec3 specular2 = light2.specular * spec2 * vec3(texture(material.specular, TexCoords));
+    vec3 specular2 = lights[1].specular * spec2 * vec3(texture(specular_map, TexCoords));
 
     vec3 result = ambient + diffuse + specular;
     //sumamos la segunda luz
     result += ambient2 + diffuse2 + specular2;
-    frag_col = vec4(result, 1.0);
+    frag_col = vec4(result * material.tint.rgb, 1.0);
 }
\ No newline at end of file
@@ -3,19 +3,42 @@
 in vec3 v_pos;
 in vec3 v_normal;
 in vec2 v_texture;
+in mat4 instance_model; // per instance (instance_buffer.h)
+in mat3 instance_normal_matrix;
+in uint instance_material;
 
 out vec3 frag_3Dpos;
 out vec3 normal;
 out vec2 TexCoords;
+flat out uint material_index;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat3 normal_matrix;
+// Frame constants, shared with the fragment shader (uniform_blocks.h)
+layout(std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    vec3 view_pos;
+};
+
+
+// Packed vertices: v_pos is 0..1 inside the mesh bounds and v_normal.xy
+// an octahedral normal. Float vertices use scale 1, offset 0 and false.
+uniform vec3 position_offset;
+uniform vec3 position_scale;
+uniform bool octahedral_normals;
+
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0);
+    n.xy += vec2(n.x >= 0.0 ? -t : t, n.y >= 0.0 ? -t : t);
+    return n;
+}
 
 void main() {
-    frag_3Dpos = vec3(model * vec4(v_pos, 1.0));
-    normal = normalize(normal_matrix * v_normal);
-    gl_Position = projection * view * model * vec4(v_pos, 1.0f);
+    vec3 pos = v_pos * position_scale + position_offset;
+    vec3 n = octahedral_normals ? octahedralDecode(v_normal.xy) : v_normal;
+    frag_3Dpos = vec3(instance_model * vec4(pos, 1.0));
+    normal = normalize(instance_normal_matrix * n);
+    gl_Position = projection * view * instance_model * vec4(pos, 1.0f);
     TexCoords = v_texture;
-}
\ No newline at end of file
+    material_index = instance_material;
+}
@@ -0,0 +1,492 @@
+// stbi_bench.cpp
+//
+// Decoding benchmark for stb_image: stbi_load, stbi_load_from_memory and
+// stbi_load_16 over a generated corpus of PNG (8 and 16 bit), JPEG, HDR
+// and GIF images of several sizes, plus the textures the program loads.
+// Reports MB/s of decoded pixels and the time spent in each decoder stage
+// (inflate, PNG defilter, JPEG IDCT and color conversion).
+//
+// Usage: ./stbi_bench [corpus_dir]
+//////////////////////////////////////////////////////////////////////
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include <jpeglib.h>
+#include <zlib.h>
+
+enum StbiStage
+{
+  STBI_STAGE_INFLATE,
+  STBI_STAGE_DEFILTER,
+  STBI_STAGE_IDCT,
+  STBI_STAGE_COLOR,
+  STBI_STAGE_COUNT
+};
+
+static const char *stage_names[STBI_STAGE_COUNT] = {"inflate", "defilter", "idct", "color"};
+static uint64_t stage_ns[STBI_STAGE_COUNT];
+
+static uint64_t nowNs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// The IDCT hook runs once per 8x8 block, so its own clock reads are part
+// of the reported IDCT time
+#define STBI_PROFILE(stage, stmt)        \
+  do                                     \
+  {                                      \
+    uint64_t stbi__t0 = nowNs();         \
+    stmt;                                \
+    stage_ns[stage] += nowNs() - stbi__t0; \
+  } while (0)
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+// Corpus generation
+//////////////////////////////////////////////////////////////////////
+
+// Smooth gradients, a few hard edges and some noise: compresses like a
+// texture, neither like a flat color nor like white noise
+static std::vector<uint8_t> makeImage(int w, int h, int comp, unsigned int seed)
+{
+  std::vector<uint8_t> px((size_t)w * h * comp);
+  unsigned int r = seed;
+  for (int y = 0; y < h; y++)
+    for (int x = 0; x < w; x++)
+    {
+      r = r * 1103515245u + 12345u;
+      int noise = (r >> 16) % 24;
+      bool stripe = ((x / 16) + (y / 24)) % 5 == 0;
+      for (int c = 0; c < comp; c++)
+      {
+        int v = (x * 255 / w) * (c + 1) / 2 + (y * 255 / h) / (c + 1) + noise;
+        if (stripe)
+          v = 255 - v;
+        px[((size_t)y * w + x) * comp + c] = (uint8_t)(c == 3 ? 255 - noise : v & 255);
+      }
+    }
+  return px;
+}
+
+static void put32(std::vector<uint8_t> &out, uint32_t v)
+{
+  out.push_back(v >> 24);
+  out.push_back(v >> 16);
+  out.push_back(v >> 8);
+  out.push_back(v);
+}
+
+static void pngChunk(std::vector<uint8_t> &out, const char *type, const uint8_t *data, size_t len)
+{
+  put32(out, (uint32_t)len);
+  size_t start = out.size();
+  out.insert(out.end(), type, type + 4);
+  out.insert(out.end(), data, data + len);
+  put32(out, (uint32_t)crc32(0, &out[start], (uInt)(len + 4)));
+}
+
+static uint8_t paeth(int a, int b, int c)
+{
+  int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+  if (pa <= pb && pa <= pc)
+    return a;
+  return pb <= pc ? b : c;
+}
+
+// Filter type cycles every row so all the defilter paths get exercised
+static std::vector<uint8_t> encodePng(const std::vector<uint8_t> &px, int w, int h, int comp, int depth)
+{
+  int bpp = comp * depth / 8;
+  size_t stride = (size_t)w * bpp;
+  std::vector<uint8_t> filtered((stride + 1) * h);
+  std::vector<uint8_t> row(stride), prev(stride, 0);
+  for (int y = 0; y < h; y++)
+  {
+    // 16 bit: expand every sample to big-endian v*257
+    for (size_t i = 0; i < stride; i++)
+      row[i] = depth == 16 ? px[(size_t)y * w * comp + i / 2] : px[(size_t)y * stride + i];
+
+    int type = y % 5;
+    uint8_t *dst = &filtered[y * (stride + 1)];
+    dst[0] = type;
+    for (size_t i = 0; i < stride; i++)
+    {
+      int a = i >= (size_t)bpp ? row[i - bpp] : 0;
+      int b = prev[i];
+      int c = i >= (size_t)bpp ? prev[i - bpp] : 0;
+      int pred = type == 1 ? a : type == 2 ? b : type == 3 ? (a + b) / 2 : type == 4 ? paeth(a, b, c) : 0;
+      dst[1 + i] = (uint8_t)(row[i] - pred);
+    }
+    prev = row;
+  }
+
+  uLongf zlen = compressBound(filtered.size());
+  std::vector<uint8_t> z(zlen);
+  compress2(z.data(), &zlen, filtered.data(), filtered.size(), 6);
+
+  static const uint8_t color_types[] = {0, 0, 4, 2, 6};
+  uint8_t ihdr[13] = {0};
+  ihdr[0] = w >> 24, ihdr[1] = w >> 16, ihdr[2] = w >> 8, ihdr[3] = w;
+  ihdr[4] = h >> 24, ihdr[5] = h >> 16, ihdr[6] = h >> 8, ihdr[7] = h;
+  ihdr[8] = depth;
+  ihdr[9] = color_types[comp];
+
+  std::vector<uint8_t> out = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+  pngChunk(out, "IHDR", ihdr, sizeof(ihdr));
+  pngChunk(out, "IDAT", z.data(), zlen);
+  pngChunk(out, "IEND", NULL, 0);
+  return out;
+}
+
+static std::vector<uint8_t> encodeJpeg(const std::vector<uint8_t> &px, int w, int h)
+{
+  jpeg_compress_struct cinfo;
+  jpeg_error_mgr jerr;
+  cinfo.err = jpeg_std_error(&jerr);
+  jpeg_create_compress(&cinfo);
+
+  unsigned char *mem = NULL;
+  unsigned long mem_size = 0;
+  jpeg_mem_dest(&cinfo, &mem, &mem_size);
+
+  cinfo.image_width = w;
+  cinfo.image_height = h;
+  cinfo.input_components = 3;
+  cinfo.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&cinfo); // 4:2:0 chroma, exercises upsampling + YCbCr
+  jpeg_set_quality(&cinfo, 90, TRUE);
+  jpeg_start_compress(&cinfo, TRUE);
+  while (cinfo.next_scanline < cinfo.image_height)
+  {
+    JSAMPROW line = (JSAMPROW)&px[(size_t)cinfo.next_scanline * w * 3];
+    jpeg_write_scanlines(&cinfo, &line, 1);
+  }
+  jpeg_finish_compress(&cinfo);
+  jpeg_destroy_compress(&cinfo);
+
+  std::vector<uint8_t> out(mem, mem + mem_size);
+  free(mem);
+  return out;
+}
+
+// Radiance RGBE with new-style run length encoded scanlines
+static std::vector<uint8_t> encodeHdr(const std::vector<uint8_t> &px, int w, int h)
+{
+  char header[128];
+  int n = snprintf(header, sizeof(header), "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %d +X %d\n", h, w);
+  std::vector<uint8_t> out(header, header + n);
+
+  std::vector<uint8_t> rgbe((size_t)w * 4);
+  for (int y = 0; y < h; y++)
+  {
+    for (int x = 0; x < w; x++)
+    {
+      const uint8_t *p = &px[((size_t)y * w + x) * 3];
+      float c[3] = {p[0] / 64.0f, p[1] / 64.0f, p[2] / 64.0f};
+      float m = c[0] > c[1] ? (c[0] > c[2] ? c[0] : c[2]) : (c[1] > c[2] ? c[1] : c[2]);
+      if (m < 1e-32f)
+      {
+        memset(&rgbe[x * 4], 0, 4);
+        continue;
+      }
+      int e;
+      float scale = frexpf(m, &e) * 256.0f / m;
+      rgbe[x * 4 + 0] = (uint8_t)(c[0] * scale);
+      rgbe[x * 4 + 1] = (uint8_t)(c[1] * scale);
+      rgbe[x * 4 + 2] = (uint8_t)(c[2] * scale);
+      rgbe[x * 4 + 3] = (uint8_t)(e + 128);
+    }
+
+    out.push_back(2);
+    out.push_back(2);
+    out.push_back(w >> 8);
+    out.push_back(w & 255);
+    for (int c = 0; c < 4; c++)
+    {
+      int x = 0;
+      while (x < w)
+      {
+        int run = 1;
+        while (x + run < w && run < 127 && rgbe[(x + run) * 4 + c] == rgbe[x * 4 + c])
+          run++;
+        if (run > 2)
+        {
+          out.push_back(128 + run);
+          out.push_back(rgbe[x * 4 + c]);
+          x += run;
+          continue;
+        }
+        int lit = 0;
+        while (x + lit < w && lit < 128)
+        {
+          if (x + lit + 2 < w && rgbe[(x + lit) * 4 + c] == rgbe[(x + lit + 1) * 4 + c] &&
+              rgbe[(x + lit) * 4 + c] == rgbe[(x + lit + 2) * 4 + c])
+            break;
+          lit++;
+        }
+        out.push_back(lit);
+        for (int i = 0; i < lit; i++)
+          out.push_back(rgbe[(x + i) * 4 + c]);
+        x += lit;
+      }
+    }
+  }
+  return out;
+}
+
+struct LzwWriter
+{
+  std::vector<uint8_t> bytes;
+  uint32_t acc = 0;
+  int bits = 0;
+
+  void put(int code, int size)
+  {
+    acc |= (uint32_t)code << bits;
+    bits += size;
+    while (bits >= 8)
+    {
+      bytes.push_back(acc & 255);
+      acc >>= 8;
+      bits -= 8;
+    }
+  }
+};
+
+// 256 color GIF, the palette is a 3-3-2 RGB cube
+static std::vector<uint8_t> encodeGif(const std::vector<uint8_t> &px, int w, int h)
+{
+  std::vector<uint8_t> out = {'G', 'I', 'F', '8', '9', 'a',
+                              (uint8_t)(w & 255), (uint8_t)(w >> 8), (uint8_t)(h & 255), (uint8_t)(h >> 8),
+                              0xf7, 0, 0};
+  for (int i = 0; i < 256; i++)
+  {
+    out.push_back((i >> 5) * 255 / 7);
+    out.push_back(((i >> 2) & 7) * 255 / 7);
+    out.push_back((i & 3) * 255 / 3);
+  }
+  uint8_t image_desc[] = {',', 0, 0, 0, 0, (uint8_t)(w & 255), (uint8_t)(w >> 8), (uint8_t)(h & 255), (uint8_t)(h >> 8), 0, 8};
+  out.insert(out.end(), image_desc, image_desc + sizeof(image_desc));
+
+  // LZW with an open addressing dictionary of (prefix code, byte) -> code
+  const int clear = 256, eoi = 257;
+  const int table_size = 1 << 14;
+  std::vector<int32_t> keys(table_size), codes(table_size);
+  LzwWriter lzw;
+  int code_size = 9, next_code = eoi + 1;
+  std::fill(keys.begin(), keys.end(), -1);
+  lzw.put(clear, code_size);
+
+  size_t count = (size_t)w * h;
+  int prefix = -1;
+  for (size_t i = 0; i < count; i++)
+  {
+    const uint8_t *p = &px[i * 3];
+    int k = (p[0] & 0xe0) | ((p[1] >> 3) & 0x1c) | (p[2] >> 6);
+    if (prefix < 0)
+    {
+      prefix = k;
+      continue;
+    }
+    int32_t key = (prefix << 8) | k;
+    int slot = (key * 2654435761u) >> 18 & (table_size - 1);
+    while (keys[slot] != -1 && keys[slot] != key)
+      slot = (slot + 1) & (table_size - 1);
+    if (keys[slot] == key)
+    {
+      prefix = codes[slot];
+      continue;
+    }
+
+    lzw.put(prefix, code_size);
+    if (next_code < 4096)
+    {
+      if (next_code == (1 << code_size))
+        code_size++;
+      keys[slot] = key;
+      codes[slot] = next_code++;
+    }
+    else
+    {
+      lzw.put(clear, code_size);
+      std::fill(keys.begin(), keys.end(), -1);
+      code_size = 9;
+      next_code = eoi + 1;
+    }
+    prefix = k;
+  }
+  lzw.put(prefix, code_size);
+  // The decoder adds one more entry on reading the last code
+  if (next_code < 4096 && next_code == (1 << code_size))
+    code_size++;
+  lzw.put(eoi, code_size);
+  if (lzw.bits > 0)
+    lzw.bytes.push_back(lzw.acc & 255);
+
+  for (size_t i = 0; i < lzw.bytes.size(); i += 255)
+  {
+    size_t n = lzw.bytes.size() - i < 255 ? lzw.bytes.size() - i : 255;
+    out.push_back((uint8_t)n);
+    out.insert(out.end(), lzw.bytes.begin() + i, lzw.bytes.begin() + i + n);
+  }
+  out.push_back(0);
+  out.push_back(';');
+  return out;
+}
+
+static bool writeFile(const std::string &path, const std::vector<uint8_t> &data)
+{
+  FILE *fp = fopen(path.c_str(), "wb");
+  if (fp == NULL)
+    return false;
+  bool ok = fwrite(data.data(), 1, data.size(), fp) == data.size();
+  fclose(fp);
+  return ok;
+}
+
+static std::vector<uint8_t> readFile(const std::string &path)
+{
+  std::vector<uint8_t> data;
+  FILE *fp = fopen(path.c_str(), "rb");
+  if (fp == NULL)
+    return data;
+  fseek(fp, 0, SEEK_END);
+  data.resize(ftell(fp));
+  rewind(fp);
+  if (fread(data.data(), 1, data.size(), fp) != data.size())
+    data.clear();
+  fclose(fp);
+  return data;
+}
+
+// Benchmark
+//////////////////////////////////////////////////////////////////////
+
+enum LoadApi
+{
+  API_LOAD,
+  API_LOAD_FROM_MEMORY,
+  API_LOAD_16,
+  API_COUNT
+};
+
+static const char *api_names[API_COUNT] = {"stbi_load", "stbi_load_from_memory", "stbi_load_16"};
+
+// Decodes the image over and over for at least min_seconds. Returns the
+// mean time per decode and leaves the per-stage totals in stage_ns.
+static double timeDecode(LoadApi api, const std::string &path, const std::vector<uint8_t> &data,
+                         size_t *out_bytes, int *iterations, double min_seconds)
+{
+  memset(stage_ns, 0, sizeof(stage_ns));
+  uint64_t start = nowNs(), elapsed = 0;
+  int n = 0;
+  do
+  {
+    int w, h, comp;
+    void *pixels = NULL;
+    if (api == API_LOAD)
+      pixels = stbi_load(path.c_str(), &w, &h, &comp, 0);
+    else if (api == API_LOAD_FROM_MEMORY)
+      pixels = stbi_load_from_memory(data.data(), (int)data.size(), &w, &h, &comp, 0);
+    else
+      pixels = stbi_load_16(path.c_str(), &w, &h, &comp, 0);
+
+    if (pixels == NULL)
+    {
+      fprintf(stderr, "ERROR: %s failed on %s: %s\n", api_names[api], path.c_str(), stbi_failure_reason());
+      return -1.0;
+    }
+    *out_bytes = (size_t)w * h * comp * (api == API_LOAD_16 ? 2 : 1);
+    stbi_image_free(pixels);
+
+    n++;
+    elapsed = nowNs() - start;
+  } while (n < 3 || elapsed < min_seconds * 1e9);
+
+  *iterations = n;
+  return elapsed * 1e-9 / n;
+}
+
+int main(int argc, char *argv[])
+{
+  std::string dir = argc > 1 ? argv[1] : "bench_corpus";
+  mkdir(dir.c_str(), 0755);
+
+  std::vector<std::string> files;
+  files.push_back("./textures/container2.png");
+  files.push_back("./textures/container2_specular.png");
+
+  const int sizes[] = {64, 256, 1024, 2048};
+  for (int size : sizes)
+  {
+    std::vector<uint8_t> rgb = makeImage(size, size, 3, size);
+    std::vector<uint8_t> rgba = makeImage(size, size, 4, size + 1);
+    std::string base = dir + "/" + std::to_string(size);
+
+    struct
+    {
+      std::string path;
+      std::vector<uint8_t> data;
+    } corpus[] = {
+        {base + "_rgb.png", encodePng(rgb, size, size, 3, 8)},
+        {base + "_rgba.png", encodePng(rgba, size, size, 4, 8)},
+        {base + "_rgb16.png", encodePng(rgb, size, size, 3, 16)},
+        {base + ".jpg", encodeJpeg(rgb, size, size)},
+        {base + ".hdr", encodeHdr(rgb, size, size)},
+        {base + ".gif", encodeGif(rgb, size, size)},
+    };
+    for (auto &c : corpus)
+    {
+      if (!writeFile(c.path, c.data))
+      {
+        fprintf(stderr, "ERROR: could not write %s\n", c.path.c_str());
+        return 1;
+      }
+      files.push_back(c.path);
+    }
+  }
+
+  printf("%-36s %-22s %9s %9s %9s %9s %9s %9s %9s\n",
+         "file", "api", "KB in", "ms", "MB/s", "inflate", "defilter", "idct", "color");
+  for (const std::string &path : files)
+  {
+    std::vector<uint8_t> data = readFile(path);
+    if (data.empty())
+    {
+      fprintf(stderr, "ERROR: could not read %s\n", path.c_str());
+      continue;
+    }
+
+    for (int api = 0; api < API_COUNT; api++)
+    {
+      size_t out_bytes = 0;
+      int n = 0;
+      double seconds = timeDecode((LoadApi)api, path, data, &out_bytes, &n, 0.2);
+      if (seconds < 0.0)
+        continue;
+
+      printf("%-36s %-22s %9.1f %9.3f %9.1f", path.c_str(), api_names[api],
+             data.size() / 1024.0, seconds * 1e3, out_bytes / seconds / 1e6);
+      for (int s = 0; s < STBI_STAGE_COUNT; s++)
+        printf(" %9.3f", stage_ns[s] * 1e-6 / n);
+      printf("\n");
+    }
+  }
+  printf("Stage columns: ms per decode spent in %s, %s, %s and %s\n",
+         stage_names[0], stage_names[1], stage_names[2], stage_names[3]);
+
+  return 0;
+}
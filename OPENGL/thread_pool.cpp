@@ -0,0 +1,131 @@
+// thread_pool.cpp
+//
+// One shared task queue. Each parallelFor() is a batch with a counter of
+// unfinished chunks; the caller helps with queued tasks until it reaches 0.
+//////////////////////////////////////////////////////////////////////
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "thread_pool.h"
+
+struct Batch
+{
+  const std::function<void(int, int)> *fn;
+  int remaining; // chunks not finished, guarded by the pool mutex
+};
+
+struct Task
+{
+  Batch *batch;
+  int begin, end;
+};
+
+struct ThreadPool
+{
+  std::vector<std::thread> workers;
+  std::deque<Task> queue;
+  std::mutex mutex;
+  std::condition_variable work_available;
+  std::condition_variable batch_done;
+  bool stop;
+};
+
+// Runs a task with the mutex released and accounts for it afterwards
+static void runTask(ThreadPool *pool, std::unique_lock<std::mutex> &lock, const Task &task)
+{
+  lock.unlock();
+  (*task.batch->fn)(task.begin, task.end);
+  lock.lock();
+
+  if (--task.batch->remaining == 0)
+    pool->batch_done.notify_all();
+}
+
+static void workerLoop(ThreadPool *pool)
+{
+  std::unique_lock<std::mutex> lock(pool->mutex);
+  for (;;)
+  {
+    pool->work_available.wait(lock, [pool] { return pool->stop || !pool->queue.empty(); });
+    if (pool->queue.empty())
+      return; // stop requested and nothing left
+
+    Task task = pool->queue.front();
+    pool->queue.pop_front();
+    runTask(pool, lock, task);
+  }
+}
+
+ThreadPool *threadPoolCreate(int threads)
+{
+  if (threads <= 0)
+    threads = (int)std::thread::hardware_concurrency() - 1;
+
+  ThreadPool *pool = new ThreadPool;
+  pool->stop = false;
+  for (int i = 0; i < threads; i++)
+    pool->workers.emplace_back(workerLoop, pool);
+  return pool;
+}
+
+void threadPoolDestroy(ThreadPool *pool)
+{
+  if (pool == NULL)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(pool->mutex);
+    pool->stop = true;
+  }
+  pool->work_available.notify_all();
+  for (std::thread &t : pool->workers)
+    t.join();
+  delete pool;
+}
+
+int threadPoolConcurrency(ThreadPool *pool)
+{
+  return pool ? (int)pool->workers.size() + 1 : 1;
+}
+
+void parallelFor(ThreadPool *pool, int count, int grain, const std::function<void(int begin, int end)> &fn)
+{
+  if (count <= 0)
+    return;
+  if (grain < 1)
+    grain = 1;
+
+  if (pool == NULL || pool->workers.empty() || count <= grain)
+  {
+    for (int begin = 0; begin < count; begin += grain)
+      fn(begin, begin + grain < count ? begin + grain : count);
+    return;
+  }
+
+  Batch batch;
+  batch.fn = &fn;
+  batch.remaining = (count + grain - 1) / grain;
+
+  std::unique_lock<std::mutex> lock(pool->mutex);
+  for (int begin = 0; begin < count; begin += grain)
+    pool->queue.push_back({&batch, begin, begin + grain < count ? begin + grain : count});
+  pool->work_available.notify_all();
+
+  // Help until our batch is finished. Tasks from other batches are fine
+  // too: they cannot depend on ours.
+  while (batch.remaining > 0)
+  {
+    if (!pool->queue.empty())
+    {
+      Task task = pool->queue.front();
+      pool->queue.pop_front();
+      runTask(pool, lock, task);
+    }
+    else
+      pool->batch_done.wait(lock);
+  }
+}
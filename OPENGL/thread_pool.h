@@ -0,0 +1,26 @@
+// thread_pool.h: worker threads for CPU-side preprocessing (mesh building)
+//
+// parallelFor() can be called from inside a task: a thread waiting for its
+// batch runs queued tasks meanwhile, so nesting never deadlocks.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <functional>
+
+struct ThreadPool;
+
+// threads = 0: one per core minus the calling thread
+ThreadPool *threadPoolCreate(int threads);
+void threadPoolDestroy(ThreadPool *pool);
+
+// Workers plus the calling thread
+int threadPoolConcurrency(ThreadPool *pool);
+
+// Calls fn(begin, end) over [0, count) in chunks of at most grain items,
+// spread over the workers and the calling thread. Returns when every chunk
+// is done. pool may be NULL: everything runs on the calling thread.
+void parallelFor(ThreadPool *pool, int count, int grain, const std::function<void(int begin, int end)> &fn);
+
+#endif
@@ -0,0 +1,127 @@
+// trace.cpp
+//
+// Per-thread ring buffers of trace events. The owning thread is the only
+// writer of its ring; the flush reads it concurrently and drops the events
+// that may have been overwritten while copying.
+//////////////////////////////////////////////////////////////////////
+
+#include <stdio.h>
+#include <time.h>
+
+#include <atomic>
+#include <vector>
+
+#include "trace.h"
+
+struct TraceEvent
+{
+  const char *name;
+  uint64_t start;
+  uint64_t end;
+};
+
+struct TraceThread
+{
+  int tid;
+  std::atomic<uint64_t> head; // events ever written
+  TraceEvent events[TRACE_RING_SIZE];
+};
+
+static TraceThread *threads[TRACE_MAX_THREADS];
+static std::atomic<int> thread_count(0);
+static thread_local TraceThread *local = NULL;
+
+uint64_t traceNow()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// First event of a thread: allocate its ring and publish it
+static TraceThread *registerThread()
+{
+  int slot = thread_count.load(std::memory_order_relaxed);
+  do
+  {
+    if (slot >= TRACE_MAX_THREADS)
+      return NULL;
+  } while (!thread_count.compare_exchange_weak(slot, slot + 1, std::memory_order_relaxed));
+
+  TraceThread *t = new TraceThread;
+  t->tid = slot + 1;
+  t->head.store(0, std::memory_order_relaxed);
+
+  // The flush only looks at non-null slots
+  __atomic_store_n(&threads[slot], t, __ATOMIC_RELEASE);
+  return t;
+}
+
+void traceRecord(const char *name, uint64_t start_ns, uint64_t end_ns)
+{
+  if (local == NULL)
+  {
+    local = registerThread();
+    if (local == NULL)
+      return;
+  }
+
+  uint64_t head = local->head.load(std::memory_order_relaxed);
+  TraceEvent &e = local->events[head & (TRACE_RING_SIZE - 1)];
+  e.name = name;
+  e.start = start_ns;
+  e.end = end_ns;
+  local->head.store(head + 1, std::memory_order_release);
+}
+
+bool traceWriteJson(const char *path)
+{
+  FILE *fp = fopen(path, "w");
+  if (fp == NULL)
+  {
+    fprintf(stderr, "ERROR: could not open %s for writing\n", path);
+    return false;
+  }
+
+  fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"spinningcube\"}}");
+
+  std::vector<TraceEvent> copy;
+  int count = thread_count.load(std::memory_order_relaxed);
+  size_t written = 0;
+  for (int i = 0; i < count; i++)
+  {
+    TraceThread *t = __atomic_load_n(&threads[i], __ATOMIC_ACQUIRE);
+    if (t == NULL)
+      continue;
+
+    uint64_t head = t->head.load(std::memory_order_acquire);
+    uint64_t first = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+    copy.clear();
+    for (uint64_t n = first; n < head; n++)
+      copy.push_back(t->events[n & (TRACE_RING_SIZE - 1)]);
+
+    // Anything the writer lapped while we copied is garbage
+    uint64_t new_head = t->head.load(std::memory_order_acquire);
+    size_t skip = 0;
+    if (new_head > TRACE_RING_SIZE && new_head - TRACE_RING_SIZE > first)
+      skip = (size_t)(new_head - TRACE_RING_SIZE - first);
+
+    fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+            t->tid, t->tid == 1 ? "main" : "worker");
+
+    for (size_t n = skip; n < copy.size(); n++)
+    {
+      const TraceEvent &e = copy[n];
+      fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+              e.name, t->tid, e.start * 1e-3, (e.end - e.start) * 1e-3);
+      written++;
+    }
+  }
+
+  fprintf(fp, "\n]}\n");
+  fclose(fp);
+
+  printf("Trace: %zu events written to %s\n", written, path);
+  return true;
+}
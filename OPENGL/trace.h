@@ -0,0 +1,39 @@
+// trace.h: lightweight CPU trace events with Chrome/Perfetto JSON export
+//
+// Every thread records into its own ring buffer (no locks, no allocation
+// after the first event), so recording can stay on in release builds.
+// Open the written file in chrome://tracing or https://ui.perfetto.dev
+//////////////////////////////////////////////////////////////////////
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// Events kept per thread (power of two), older ones are overwritten
+#define TRACE_RING_SIZE 16384
+#define TRACE_MAX_THREADS 64
+
+// Monotonic time in nanoseconds
+uint64_t traceNow();
+
+// name must outlive the trace (string literals)
+void traceRecord(const char *name, uint64_t start_ns, uint64_t end_ns);
+
+// Writes every event still in the rings. Safe while other threads record.
+bool traceWriteJson(const char *path);
+
+struct TraceScope
+{
+  const char *name;
+  uint64_t start;
+
+  explicit TraceScope(const char *event_name) : name(event_name), start(traceNow()) {}
+  ~TraceScope() { traceRecord(name, start, traceNow()); }
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+#endif
@@ -0,0 +1,83 @@
+// uniform_blocks.cpp
+//////////////////////////////////////////////////////////////////////
+
+#include <string.h>
+
+#include "gl_state.h"
+#include "uniform_blocks.h"
+
+static const char *const block_names[UNIFORM_BLOCK_COUNT] = {"Camera", "Lights", "Material"};
+static const size_t block_sizes[UNIFORM_BLOCK_COUNT] = {sizeof(CameraBlock), sizeof(LightsBlock),
+                                                        sizeof(MaterialBlock)};
+
+void uniformBufferCreate(UniformBuffer *ub)
+{
+  // Ranges bound with glBindBufferRange() must start at multiples of this
+  GLint alignment = 256;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+  GLintptr size = 0;
+  for (int b = 0; b < UNIFORM_BLOCK_COUNT; b++)
+  {
+    ub->offset[b] = size;
+    size += (block_sizes[b] + alignment - 1) / alignment * alignment;
+  }
+  ub->staging.assign(size, 0);
+  for (int b = 0; b < UNIFORM_BLOCK_COUNT; b++)
+    ub->dirty[b] = true;
+
+  glGenBuffers(1, &ub->buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, ub->buffer);
+  glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+  for (int b = 0; b < UNIFORM_BLOCK_COUNT; b++)
+    glBindBufferRange(GL_UNIFORM_BUFFER, b, ub->buffer, ub->offset[b], block_sizes[b]);
+}
+
+void uniformBufferDestroy(UniformBuffer *ub)
+{
+  glDeleteBuffers(1, &ub->buffer);
+  ub->buffer = 0;
+}
+
+void uniformBufferSet(UniformBuffer *ub, UniformBlock block, const void *data, size_t size)
+{
+  unsigned char *stored = ub->staging.data() + ub->offset[block];
+  if (memcmp(stored, data, size) == 0)
+    return;
+  memcpy(stored, data, size);
+  ub->dirty[block] = true;
+}
+
+void uniformBufferUpload(UniformBuffer *ub)
+{
+  int first = UNIFORM_BLOCK_COUNT, last = -1;
+  for (int b = 0; b < UNIFORM_BLOCK_COUNT; b++)
+    if (ub->dirty[b])
+    {
+      first = b < first ? b : first;
+      last = b;
+    }
+  stateCount(last < 0);
+  if (last < 0)
+    return;
+
+  GLintptr begin = ub->offset[first];
+  GLintptr end = last + 1 < UNIFORM_BLOCK_COUNT ? ub->offset[last + 1] : (GLintptr)ub->staging.size();
+  glBindBuffer(GL_UNIFORM_BUFFER, ub->buffer);
+  glBufferSubData(GL_UNIFORM_BUFFER, begin, end - begin, ub->staging.data() + begin);
+  glBindBuffer(GL_UNIFORM_BUFFER, 0);
+  for (int b = first; b <= last; b++)
+    ub->dirty[b] = false;
+}
+
+void bindUniformBlocks(GLuint program)
+{
+  for (int b = 0; b < UNIFORM_BLOCK_COUNT; b++)
+  {
+    GLuint index = glGetUniformBlockIndex(program, block_names[b]);
+    if (index != GL_INVALID_INDEX)
+      glUniformBlockBinding(program, index, b);
+  }
+}
@@ -0,0 +1,91 @@
+// uniform_blocks.h: frame constant shader data in std140 uniform blocks
+//
+// Camera, lights and material live in one uniform buffer, each block at
+// its own aligned range bound to a fixed binding point. A frame writes the
+// blocks into a CPU copy and sends the blocks that changed with one
+// glBufferSubData(), or nothing at all; programs only need
+// bindUniformBlocks() once after linking to read the same data.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef UNIFORM_BLOCKS_H
+#define UNIFORM_BLOCKS_H
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Binding points, also the order of the blocks in the buffer
+enum UniformBlock
+{
+  UNIFORM_BLOCK_CAMERA,   // "Camera" in the shaders
+  UNIFORM_BLOCK_LIGHTS,   // "Lights"
+  UNIFORM_BLOCK_MATERIAL, // "Material"
+  UNIFORM_BLOCK_COUNT
+};
+
+#define MAX_LIGHTS 2
+// Materials an instance can pick from (InstanceData::material)
+#define MAX_MATERIALS 8
+
+// std140 mirrors of the GLSL blocks: a vec3 takes 16 bytes, so they are
+// stored as vec4 (w unused)
+struct CameraBlock
+{
+  glm::mat4 view;
+  glm::mat4 projection;
+  glm::vec4 view_pos;
+};
+
+struct LightStd140
+{
+  glm::vec4 position;
+  glm::vec4 ambient;
+  glm::vec4 diffuse;
+  glm::vec4 specular;
+};
+
+struct LightsBlock
+{
+  LightStd140 lights[MAX_LIGHTS];
+};
+
+struct MaterialStd140
+{
+  glm::vec4 tint; // multiplies the lit color
+  float shininess;
+  float padding[3];
+};
+
+struct MaterialBlock
+{
+  MaterialStd140 materials[MAX_MATERIALS];
+};
+
+static_assert(sizeof(CameraBlock) == 144, "CameraBlock does not match std140");
+static_assert(sizeof(LightsBlock) == 64 * MAX_LIGHTS, "LightsBlock does not match std140");
+static_assert(sizeof(MaterialBlock) == 32 * MAX_MATERIALS, "MaterialBlock does not match std140");
+
+struct UniformBuffer
+{
+  GLuint buffer;
+  GLintptr offset[UNIFORM_BLOCK_COUNT];
+  std::vector<unsigned char> staging; // CPU copy of the whole buffer
+  bool dirty[UNIFORM_BLOCK_COUNT];    // staging differs from the GPU copy
+};
+
+// Creates the buffer and binds each block's range to its binding point.
+// Needs the GL context.
+void uniformBufferCreate(UniformBuffer *ub);
+void uniformBufferDestroy(UniformBuffer *ub);
+
+// Copies a block into the CPU copy, marking it dirty if it changed.
+// Nothing reaches the GPU until uniformBufferUpload(), which sends the
+// span from the first to the last dirty block (counted in gl_state.h).
+void uniformBufferSet(UniformBuffer *ub, UniformBlock block, const void *data, size_t size);
+void uniformBufferUpload(UniformBuffer *ub);
+
+// Points the blocks program declares at the binding points
+void bindUniformBlocks(GLuint program);
+
+#endif